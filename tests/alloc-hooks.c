@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Allocator interposer for the allocation tests (loaded with LD_PRELOAD)
+//
+// Counts the allocations of the process and the allocated bytes. Whenever the
+// process writes an event to XDGSS_TRACE and when it exits, the line
+// "PID EVENT ALLOCS BYTES LIVE PEAK" is appended to ALLOC_HOOKS_REPORT.
+// ALLOCS and BYTES are totals, LIVE is the heap usage and PEAK the highest
+// heap usage since the previous line. Nothing in here allocates.
+// allocHooksAllocs returns the number of allocations so far.
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <sys/syscall.h>
+
+#define EXPORT __attribute__((visibility("default")))
+
+// The allocator of glibc
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+
+struct allocHooksData_t {
+    unsigned long allocs, bytes;
+    long live, peak;
+} allocHooksData;
+
+void countAlloc(void *ptr) {
+    struct allocHooksData_t *d = &allocHooksData;
+    if (ptr == NULL) {
+        return;
+    }
+    size_t size = malloc_usable_size(ptr);
+    d->allocs++;
+    d->bytes += size;
+    d->live += (long)size;
+    if (d->live > d->peak) {
+        d->peak = d->live;
+    }
+}
+
+void countFree(void *ptr) {
+    struct allocHooksData_t *d = &allocHooksData;
+    if (ptr != NULL) {
+        d->live -= (long)malloc_usable_size(ptr);
+    }
+}
+
+void report(const char *event, size_t eventLen) {
+    struct allocHooksData_t *d = &allocHooksData;
+    const char *path = getenv("ALLOC_HOOKS_REPORT");
+    char line[256];
+    int fd, len;
+    if (path == NULL ||
+            (fd = (int)syscall(SYS_open, path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                               0600)) < 0) {
+        return;
+    }
+    len = snprintf(line, sizeof(line), "%d %.*s %lu %lu %ld %ld\n", getpid(), (int)eventLen,
+                   event, d->allocs, d->bytes, d->live, d->peak);
+    if (len > 0 && (size_t)len < sizeof(line)) {
+        syscall(SYS_write, fd, line, (size_t)len);
+    }
+    syscall(SYS_close, fd);
+    d->peak = d->live;
+}
+
+EXPORT void *malloc(size_t size) {
+    void *ptr = __libc_malloc(size);
+    countAlloc(ptr);
+    return ptr;
+}
+
+EXPORT void *calloc(size_t nmemb, size_t size) {
+    void *ptr = __libc_calloc(nmemb, size);
+    countAlloc(ptr);
+    return ptr;
+}
+
+EXPORT void *realloc(void *ptr, size_t size) {
+    // Counted like free and malloc, even if the block grows in place
+    size_t oldSize = ptr != NULL ? malloc_usable_size(ptr) : 0;
+    void *newPtr = __libc_realloc(ptr, size);
+    if (newPtr != NULL || size == 0) {
+        allocHooksData.live -= (long)oldSize;
+        countAlloc(newPtr);
+    }
+    return newPtr;
+}
+
+EXPORT void *reallocarray(void *ptr, size_t nmemb, size_t size) {
+    size_t total;
+    if (__builtin_mul_overflow(nmemb, size, &total)) {
+        return NULL;
+    }
+    return realloc(ptr, total);
+}
+
+EXPORT void *memalign(size_t alignment, size_t size) {
+    void *ptr = __libc_memalign(alignment, size);
+    countAlloc(ptr);
+    return ptr;
+}
+
+EXPORT void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+EXPORT int posix_memalign(void **returnPtr, size_t alignment, size_t size) {
+    void *ptr = memalign(alignment, size);
+    if (ptr == NULL) {
+        return size > 0 ? 12 /* ENOMEM */ : 0;
+    }
+    *returnPtr = ptr;
+    return 0;
+}
+
+EXPORT void *valloc(size_t size) {
+    return memalign((size_t)sysconf(_SC_PAGESIZE), size);
+}
+
+EXPORT void free(void *ptr) {
+    countFree(ptr);
+    __libc_free(ptr);
+}
+
+// XDGSS_TRACE lines are written at once with write
+EXPORT ssize_t write(int fd, const void *buf, size_t count) {
+    static const char prefix[] = "{\"ts_ns\":";
+    static const char eventKey[] = "\"event\":\"";
+    ssize_t written = syscall(SYS_write, fd, buf, count);
+    const char *event;
+    if (written > 0 && count >= sizeof(prefix) - 1 &&
+            memcmp(buf, prefix, sizeof(prefix) - 1) == 0 &&
+            (event = memmem(buf, count, eventKey, sizeof(eventKey) - 1)) != NULL) {
+        event += sizeof(eventKey) - 1;
+        const char *eventEnd = memchr(event, '"', count - (size_t)(event - (const char *)buf));
+        if (eventEnd != NULL) {
+            report(event, (size_t)(eventEnd - event));
+        }
+    }
+    return written;
+}
+
+// Allocations so far, for programs that look it up with dlsym
+EXPORT unsigned long allocHooksAllocs(void) {
+    return allocHooksData.allocs;
+}
+
+__attribute__((destructor)) void reportExit() {
+    report("exit", 4);
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// End-to-end latency of suspend and of the release of the inhibition
+//
+// bench-e2e XDG_SCREENSAVER MOCK_SCREENSAVER [ITERATIONS] [MOCK_DELAY_US]
+//
+// Measures with mock-screensaver replying after MOCK_DELAY_US:
+// - suspend: until "xdg-screensaver suspend" returns to the caller
+// - resume to UnInhibit: from starting "xdg-screensaver resume" until the
+//   mock receives UnInhibit
+// - destroy to UnInhibit: from XDestroyWindow until the mock receives
+//   UnInhibit
+// - the same for "suspend --pid" and the exit of the process
+// The window phases are skipped without Xvfb.
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "harness.h"
+
+#define cleanReturn(value) do { returnValue = value; goto cleanReturn; } while (false)
+
+enum phase_t {
+    PHASE_RESUME,
+    PHASE_DESTROY,
+    PHASE_PROCESS_EXIT
+};
+
+// Suspend and release iterations times, release is measured until the mock
+// receives UnInhibit
+bool runPhase(struct harness_t *h, const char *cli, enum phase_t phase, size_t iterations) {
+    bool returnValue = true;
+    int64_t *samples = calloc(3 * iterations, sizeof(int64_t));
+    int64_t *suspendNs = samples, *inhibitNs = &samples[iterations],
+            *releaseNs = &samples[2 * iterations];
+    char target[32];
+    struct harnessEvent_t event;
+    if (samples == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    unsigned long doubleUninhibits = h->doubleUninhibits;
+    for (size_t i = 0; i < iterations; i++) {
+        unsigned long window = 0;
+        pid_t targetPid = 0;
+        if (phase == PHASE_PROCESS_EXIT) {
+            char *targetArgv[] = {"sleep", "1000", NULL};
+            if ((targetPid = harnessSpawn(targetArgv)) < 0) {
+                cleanReturn(false);
+            }
+            snprintf(target, sizeof(target), "%d", targetPid);
+        } else {
+#ifdef HAVE_X11
+            window = harnessCreateWindow(h);
+#endif
+            harnessWindowArg(window, target);
+        }
+        char *suspendArgv[] = {(char *)cli, "suspend", target, NULL};
+        char *suspendPidArgv[] = {(char *)cli, "suspend", "--pid", target, NULL};
+        char *resumeArgv[] = {(char *)cli, "resume", target, NULL};
+        int64_t t0 = harnessNow();
+        if (harnessRun(phase == PHASE_PROCESS_EXIT ? suspendPidArgv : suspendArgv) != 0) {
+            fprintf(stderr, "suspend failed\n");
+            cleanReturn(false);
+        }
+        suspendNs[i] = harnessNow() - t0;
+        if (!harnessWaitEvent(h, "inhibit", 5000, &event)) {
+            fprintf(stderr, "No Inhibit call\n");
+            cleanReturn(false);
+        }
+        inhibitNs[i] = event.tsNs - t0;
+        int64_t t1 = harnessNow();
+        if (phase == PHASE_RESUME) {
+            if (harnessRun(resumeArgv) != 0) {
+                fprintf(stderr, "resume failed\n");
+                cleanReturn(false);
+            }
+        } else if (phase == PHASE_DESTROY) {
+#ifdef HAVE_X11
+            harnessDestroyWindow(h, window);
+            window = 0;
+#endif
+        } else {
+            kill(targetPid, SIGKILL);
+        }
+        if (!harnessWaitEvent(h, "uninhibit", 5000, &event)) {
+            fprintf(stderr, "No UnInhibit call\n");
+            cleanReturn(false);
+        }
+        releaseNs[i] = event.tsNs - t1;
+        if (targetPid > 0) {
+            waitpid(targetPid, NULL, 0);
+        }
+#ifdef HAVE_X11
+        if (window != 0) {
+            harnessDestroyWindow(h, window);
+        }
+#endif
+    }
+    harnessSettle(h, 200);
+    const char *names[][2] = {
+        [PHASE_RESUME] = {"window, resume", "  resume to UnInhibit"},
+        [PHASE_DESTROY] = {"window, destroyed", "  destroy to UnInhibit"},
+        [PHASE_PROCESS_EXIT] = {"process (--pid), killed", "  exit to UnInhibit"}};
+    printf("%s\n", names[phase][0]);
+    harnessReport("  suspend", suspendNs, iterations);
+    harnessReport("  suspend to Inhibit", inhibitNs, iterations);
+    harnessReport(names[phase][1], releaseNs, iterations);
+    if (harnessActive(h) > 0 || h->doubleUninhibits > doubleUninhibits) {
+        fprintf(stderr, "%lu inhibitions left active, %lu released twice\n",
+                harnessActive(h), h->doubleUninhibits - doubleUninhibits);
+        cleanReturn(false);
+    }
+cleanReturn:
+    free(samples);
+    return returnValue;
+}
+
+int main(int argc, char *argv[]) {
+    struct harness_t h;
+    if (argc < 3 || argc > 5) {
+        fprintf(stderr, "Usage: %s XDG_SCREENSAVER MOCK_SCREENSAVER [ITERATIONS] "
+                "[MOCK_DELAY_US]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *cli = argv[1];
+    size_t iterations = argc > 3 ? strtoul(argv[3], NULL, 10) : 2000;
+    unsigned long mockDelayUs = argc > 4 ? strtoul(argv[4], NULL, 10) : 0;
+    if (!harnessStart(&h, argv[2], mockDelayUs, true)) {
+        harnessStop(&h);
+        return EXIT_FAILURE;
+    }
+    printf("%zu iterations, mock replies after %lu us\n", iterations, mockDelayUs);
+    bool ok = true;
+    if (harnessHasX(&h)) {
+        ok = runPhase(&h, cli, PHASE_RESUME, iterations) &&
+             runPhase(&h, cli, PHASE_DESTROY, iterations);
+    } else {
+        printf("Xvfb not found, skipping windows\n");
+    }
+    ok = ok && runPhase(&h, cli, PHASE_PROCESS_EXIT, iterations);
+    harnessStop(&h);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
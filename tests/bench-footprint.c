@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Memory of the background suspend processes with N concurrent inhibitions
+//
+// bench-footprint XDG_SCREENSAVER MOCK_SCREENSAVER [N...]
+//
+// For each N (default 1, 10 and 100) suspends for N windows on Xvfb (for N
+// processes with "suspend --pid" without Xvfb) and reports the RSS and PSS of
+// every background process (minimum, average and maximum) and their total.
+// PSS splits the pages shared between the processes (libraries, pages of the
+// parent that weren't written after fork), so total PSS is the memory that
+// the N inhibitions cost together. Fails if an inhibition or a background
+// process is left after releasing them.
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include "harness.h"
+
+#define cleanReturn(value) do { returnValue = value; goto cleanReturn; } while (false)
+
+// Minimum, sum and maximum of a value of all background processes
+struct footprint_t {
+    long minKb;
+    long totalKb;
+    long maxKb;
+};
+
+void footprintAdd(struct footprint_t *footprint, long kb) {
+    if (footprint->minKb < 0 || kb < footprint->minKb) {
+        footprint->minKb = kb;
+    }
+    if (kb > footprint->maxKb) {
+        footprint->maxKb = kb;
+    }
+    footprint->totalKb += kb;
+}
+
+void footprintReport(const char *name, const struct footprint_t *footprint, size_t n) {
+    printf("  %s per process: min %ld kB, avg %.0f kB, max %ld kB, total %ld kB\n", name,
+           footprint->minKb, (double)footprint->totalKb / (double)n, footprint->maxKb,
+           footprint->totalKb);
+}
+
+bool runLevel(struct harness_t *h, const char *cli, size_t n) {
+    bool returnValue = true;
+    bool withX = harnessHasX(h);
+    // Windows or target processes
+    unsigned long *windows = calloc(n, sizeof(unsigned long));
+    pid_t *targetPids = calloc(n, sizeof(pid_t)), *pids = calloc(n + 1, sizeof(pid_t));
+    size_t targetsLen = 0;
+    char target[32];
+    struct harnessEvent_t event;
+    if (windows == NULL || targetPids == NULL || pids == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+    unsigned long doubleUninhibits = h->doubleUninhibits;
+    for (; targetsLen < n; targetsLen++) {
+        char *targetArgv[] = {"sleep", "100000", NULL};
+        if (withX) {
+#ifdef HAVE_X11
+            if ((windows[targetsLen] = harnessCreateWindow(h)) == 0) {
+                fprintf(stderr, "Failed to create window\n");
+                cleanReturn(false);
+            }
+#endif
+            harnessWindowArg(windows[targetsLen], target);
+        } else {
+            if ((targetPids[targetsLen] = harnessSpawn(targetArgv)) < 0) {
+                cleanReturn(false);
+            }
+            snprintf(target, sizeof(target), "%d", targetPids[targetsLen]);
+        }
+        char *suspendArgv[] = {(char *)cli, "suspend", target, NULL};
+        char *suspendPidArgv[] = {(char *)cli, "suspend", "--pid", target, NULL};
+        if (harnessRun(withX ? suspendArgv : suspendPidArgv) != 0) {
+            fprintf(stderr, "suspend %zu failed\n", targetsLen);
+            cleanReturn(false);
+        }
+        if (!harnessWaitEvent(h, "inhibit", 5000, &event)) {
+            fprintf(stderr, "No Inhibit call for suspend %zu\n", targetsLen);
+            cleanReturn(false);
+        }
+    }
+    // Background processes register their status sockets after Inhibit
+    size_t pidsLen = 0;
+    for (int i = 0; i < 500 && (pidsLen = harnessInhibitorPids(h, pids, n + 1)) < n; i++) {
+        usleep(10000);
+    }
+    if (pidsLen != n) {
+        fprintf(stderr, "%zu background processes for %zu inhibitions\n", pidsLen, n);
+        cleanReturn(false);
+    }
+    // Memory after the processes settled in their wait loop
+    harnessSettle(h, 500);
+    struct footprint_t rss = {.minKb = -1}, pss = {.minKb = -1};
+    for (size_t i = 0; i < pidsLen; i++) {
+        long processRssKb = harnessRssKb(pids[i]), processPssKb = harnessPssKb(pids[i]);
+        if (processRssKb < 0 || processPssKb < 0) {
+            fprintf(stderr, "Failed to read /proc of %d\n", pids[i]);
+            cleanReturn(false);
+        }
+        footprintAdd(&rss, processRssKb);
+        footprintAdd(&pss, processPssKb);
+    }
+    printf("N=%zu (%s)\n", n, withX ? "windows" : "--pid");
+    footprintReport("RSS", &rss, n);
+    footprintReport("PSS", &pss, n);
+    // Release all, by destroying the windows or ending the processes
+    for (size_t i = 0; i < n; i++) {
+#ifdef HAVE_X11
+        if (withX) {
+            harnessDestroyWindow(h, windows[i]);
+            windows[i] = 0;
+        }
+#endif
+        if (targetPids[i] > 0) {
+            kill(targetPids[i], SIGKILL);
+        }
+        harnessSettle(h, 0);
+    }
+    for (int i = 0; i < 1000 && (harnessActive(h) > 0 || harnessInhibitorPids(h, pids, 1) > 0);
+            i++) {
+        harnessSettle(h, 10);
+    }
+    harnessSettle(h, 200);
+    pidsLen = harnessInhibitorPids(h, pids, n + 1);
+    if (harnessActive(h) > 0 || h->doubleUninhibits > doubleUninhibits || pidsLen > 0) {
+        fprintf(stderr, "%lu inhibitions left active, %lu released twice, %zu processes left\n",
+                harnessActive(h), h->doubleUninhibits - doubleUninhibits, pidsLen);
+        cleanReturn(false);
+    }
+cleanReturn:
+    for (size_t i = 0; i < targetsLen; i++) {
+#ifdef HAVE_X11
+        if (windows[i] != 0) {
+            harnessDestroyWindow(h, windows[i]);
+        }
+#endif
+        if (targetPids[i] > 0) {
+            kill(targetPids[i], SIGKILL);
+            waitpid(targetPids[i], NULL, 0);
+        }
+    }
+    free(pids);
+    free(targetPids);
+    free(windows);
+    return returnValue;
+}
+
+int main(int argc, char *argv[]) {
+    struct harness_t h;
+    size_t defaultLevels[] = {1, 10, 100};
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s XDG_SCREENSAVER MOCK_SCREENSAVER [N...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *cli = argv[1];
+    // Background processes are reparented to this process
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+    if (!harnessStart(&h, argv[2], 0, true)) {
+        harnessStop(&h);
+        return EXIT_FAILURE;
+    }
+    if (!harnessHasX(&h)) {
+        printf("Xvfb not found, suspending for processes instead of windows\n");
+    }
+    bool ok = true;
+    size_t levelsLen = argc > 3 ? (size_t)argc - 3
+                                : sizeof(defaultLevels)/sizeof(defaultLevels[0]);
+    for (size_t i = 0; ok && i < levelsLen; i++) {
+        size_t n = argc > 3 ? strtoul(argv[3 + i], NULL, 10) : defaultLevels[i];
+        ok = n > 0 && runLevel(&h, cli, n);
+        // Exited background processes
+        while (waitpid(-1, NULL, WNOHANG) > 0) {}
+    }
+    harnessStop(&h);
+    while (waitpid(-1, NULL, WNOHANG) > 0) {}
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Per-toggle latency of "xdg-screensaver suspend|resume WindowID" spawned by
+// an application, without and with libxdgss-preload
+//
+// bench-preload XDG_SCREENSAVER MOCK_SCREENSAVER PRELOAD_MODULE [ITERATIONS]
+//
+// The application (this program) runs both commands with posix_spawnp. The
+// directory of XDG_SCREENSAVER is put first in PATH, so intercepted resumes
+// scan /proc for it like for an installed xdg-screensaver.
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/wait.h>
+#include "harness.h"
+
+#define cleanReturn(value) do { returnValue = value; goto cleanReturn; } while (false)
+
+unsigned long countProcesses() {
+    unsigned long count = 0;
+    DIR *dir = opendir("/proc");
+    struct dirent *entry;
+    while (dir != NULL && (entry = readdir(dir)) != NULL) {
+        count += entry->d_name[0] >= '0' && entry->d_name[0] <= '9';
+    }
+    if (dir != NULL) {
+        closedir(dir);
+    }
+    return count;
+}
+
+// Suspend and resume a new window iterations times
+bool runToggles(struct harness_t *h, const char *label, size_t iterations) {
+    bool returnValue = true;
+    int64_t *samples = calloc(4 * iterations, sizeof(int64_t));
+    int64_t *suspendNs = samples, *resumeNs = &samples[iterations],
+            *toggleNs = &samples[2 * iterations], *releaseNs = &samples[3 * iterations];
+    char name[64], window[32];
+    if (samples == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    unsigned long inhibits = h->inhibits, uninhibits = h->uninhibits;
+    for (size_t i = 0; i < iterations; i++) {
+        struct harnessEvent_t event;
+        unsigned long w = harnessCreateWindow(h);
+        harnessWindowArg(w, window);
+        char *suspendArgv[] = {"xdg-screensaver", "suspend", window, NULL};
+        char *resumeArgv[] = {"xdg-screensaver", "resume", window, NULL};
+        int64_t t0 = harnessNow();
+        if (harnessRun(suspendArgv) != 0) {
+            fprintf(stderr, "suspend failed\n");
+            cleanReturn(false);
+        }
+        int64_t t1 = harnessNow();
+        if (!harnessWaitEvent(h, "inhibit", 5000, &event)) {
+            fprintf(stderr, "No Inhibit call\n");
+            cleanReturn(false);
+        }
+        int64_t t2 = harnessNow();
+        if (harnessRun(resumeArgv) != 0) {
+            fprintf(stderr, "resume failed\n");
+            cleanReturn(false);
+        }
+        int64_t t3 = harnessNow();
+        if (!harnessWaitEvent(h, "uninhibit", 5000, &event)) {
+            fprintf(stderr, "No UnInhibit call\n");
+            cleanReturn(false);
+        }
+        suspendNs[i] = t1 - t0;
+        resumeNs[i] = t3 - t2;
+        toggleNs[i] = suspendNs[i] + resumeNs[i];
+        releaseNs[i] = event.tsNs - t2;
+        harnessDestroyWindow(h, w);
+    }
+    harnessSettle(h, 200);
+    printf("%s (%lu processes in /proc)\n", label, countProcesses());
+    snprintf(name, sizeof(name), "  suspend");
+    harnessReport(name, suspendNs, iterations);
+    snprintf(name, sizeof(name), "  resume");
+    harnessReport(name, resumeNs, iterations);
+    snprintf(name, sizeof(name), "  toggle");
+    harnessReport(name, toggleNs, iterations);
+    snprintf(name, sizeof(name), "  resume to UnInhibit");
+    harnessReport(name, releaseNs, iterations);
+    if (h->inhibits - inhibits != iterations || h->uninhibits - uninhibits != iterations ||
+            h->doubleUninhibits > 0) {
+        fprintf(stderr, "%lu Inhibit, %lu UnInhibit and %lu double UnInhibit calls\n",
+                h->inhibits - inhibits, h->uninhibits - uninhibits, h->doubleUninhibits);
+        cleanReturn(false);
+    }
+cleanReturn:
+    free(samples);
+    return returnValue;
+}
+
+int main(int argc, char *argv[]) {
+    struct harness_t h;
+    if (argc == 4 && strcmp(argv[1], "--preloaded") == 0) {
+        // Second run with LD_PRELOAD
+        if (!harnessAttach(&h, atoi(argv[2]))) {
+            return EXIT_FAILURE;
+        }
+        bool ok = runToggles(&h, "after (LD_PRELOAD, serviced in-process)",
+                             strtoul(argv[3], NULL, 10));
+        harnessDetach(&h);
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (argc != 4 && argc != 5) {
+        fprintf(stderr, "Usage: %s XDG_SCREENSAVER MOCK_SCREENSAVER PRELOAD_MODULE "
+                "[ITERATIONS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    size_t iterations = argc == 5 ? strtoul(argv[4], NULL, 10) : 200;
+    char cliPath[PATH_MAX], path[2 * PATH_MAX], fdArg[16], iterationsArg[32];
+    snprintf(cliPath, sizeof(cliPath), "%s", argv[1]);
+    snprintf(path, sizeof(path), "%s:%s", dirname(cliPath),
+             getenv("PATH") != NULL ? getenv("PATH") : "/usr/bin:/bin");
+    setenv("PATH", path, true);
+    if (!harnessStart(&h, argv[2], 0, true)) {
+        harnessStop(&h);
+        return EXIT_FAILURE;
+    }
+    if (!harnessHasX(&h)) {
+        printf("Xvfb not found\n");
+        harnessStop(&h);
+        return HARNESS_SKIP;
+    }
+    int exitStatus = EXIT_FAILURE;
+    if (!runToggles(&h, "before (spawned xdg-screensaver)", iterations)) {
+        goto stop;
+    }
+    fflush(stdout);
+    // The child reads the mock's lines from the same pipe
+    fcntl(h.mockFd, F_SETFD, 0);
+    snprintf(fdArg, sizeof(fdArg), "%d", h.mockFd);
+    snprintf(iterationsArg, sizeof(iterationsArg), "%zu", iterations);
+    setenv("LD_PRELOAD", argv[3], true);
+    char *childArgv[] = {"/proc/self/exe", "--preloaded", fdArg, iterationsArg, NULL};
+    int status = harnessRun(childArgv);
+    unsetenv("LD_PRELOAD");
+    exitStatus = status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+stop:
+    harnessStop(&h);
+    return exitStatus;
+}
@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Resource usage with N concurrent inhibitions
+//
+// bench-scale XDG_SCREENSAVER MOCK_SCREENSAVER [N...]
+//
+// For each N (default 10, 100 and 1000) creates N windows on Xvfb and runs
+// "xdg-screensaver suspend" for each of them. Without Xvfb it suspends for N
+// processes with "suspend --pid". With all inhibitions active it reports:
+// - RSS and file descriptors of the background processes (total and per
+//   process)
+// - connections to dbus-daemon and its RSS
+// - X clients (with XRes, otherwise descriptors of Xvfb)
+// Then it measures the release latency on up to SAMPLES of them (resume to
+// UnInhibit or process exit to UnInhibit), releases the rest and fails if an
+// inhibition or a background process is left.
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <dbus/dbus.h>
+#include "harness.h"
+#ifdef HAVE_XRES
+#include <X11/extensions/XRes.h>
+#endif
+
+#define cleanReturn(value) do { returnValue = value; goto cleanReturn; } while (false)
+
+// Inhibitions whose release latency is measured
+#define SAMPLES 100
+
+// Connections to the bus (unique names, -1 on failure)
+long busConnections() {
+    long returnValue = -1;
+    DBusError dbusErr;
+    DBusConnection *conn = NULL;
+    DBusMessage *msg = NULL, *reply = NULL;
+    char **names = NULL;
+    int namesLen = 0;
+    dbus_error_init(&dbusErr);
+    if ((conn = dbus_bus_get_private(DBUS_BUS_SESSION, &dbusErr)) == NULL) {
+        fprintf(stderr, "Failed to connect to the bus: %s\n", dbusErr.message);
+        cleanReturn(-1);
+    }
+    if ((msg = dbus_message_new_method_call("org.freedesktop.DBus", "/org/freedesktop/DBus",
+                                            "org.freedesktop.DBus", "ListNames")) == NULL ||
+            (reply = dbus_connection_send_with_reply_and_block(conn, msg, 5000,
+                                                               &dbusErr)) == NULL ||
+            !dbus_message_get_args(reply, &dbusErr, DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+                                   &names, &namesLen, DBUS_TYPE_INVALID)) {
+        fprintf(stderr, "Failed to list names: %s\n",
+                dbus_error_is_set(&dbusErr) ? dbusErr.message : "out of memory");
+        cleanReturn(-1);
+    }
+    returnValue = 0;
+    for (int i = 0; i < namesLen; i++) {
+        if (names[i][0] == ':') {
+            returnValue++;
+        }
+    }
+cleanReturn:
+    dbus_free_string_array(names);
+    if (reply != NULL) {
+        dbus_message_unref(reply);
+    }
+    if (msg != NULL) {
+        dbus_message_unref(msg);
+    }
+    if (conn != NULL) {
+        dbus_connection_close(conn);
+        dbus_connection_unref(conn);
+    }
+    dbus_error_free(&dbusErr);
+    return returnValue;
+}
+
+// Clients of the X server (-1 without Xvfb)
+long xClients(struct harness_t *h) {
+#ifdef HAVE_X11
+    if (harnessHasX(h)) {
+#ifdef HAVE_XRES
+        int clientsLen;
+        XResClient *clients;
+        if (XResQueryClients(h->display, &clientsLen, &clients)) {
+            XFree(clients);
+            return clientsLen;
+        }
+#endif
+        // Every client has a connection
+        return harnessFdCount(h->xvfbPid);
+    }
+#endif
+    (void)h;
+    return -1;
+}
+
+// Wait until inhibits calls of the mock were received since the start
+bool waitInhibits(struct harness_t *h, unsigned long inhibits, int timeoutMs) {
+    int64_t deadline = harnessNow() + (int64_t)timeoutMs * 1000000;
+    struct harnessEvent_t event;
+    while (h->inhibits < inhibits) {
+        int64_t remainingMs = (deadline - harnessNow()) / 1000000;
+        if (remainingMs <= 0 || !harnessNextEvent(h, (int)remainingMs, &event)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool runLevel(struct harness_t *h, const char *cli, size_t n, long baseConnections,
+              long baseXClients) {
+    bool returnValue = true;
+    bool withX = harnessHasX(h);
+    // Windows or target processes
+    unsigned long *windows = calloc(n, sizeof(unsigned long));
+    pid_t *targetPids = calloc(n, sizeof(pid_t)), *pids = calloc(n + 1, sizeof(pid_t));
+    int64_t *releaseNs = calloc(SAMPLES, sizeof(int64_t));
+    size_t targetsLen = 0, samplesLen = 0;
+    char target[32];
+    struct harnessEvent_t event;
+    if (windows == NULL || targetPids == NULL || pids == NULL || releaseNs == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+    unsigned long inhibits = h->inhibits, doubleUninhibits = h->doubleUninhibits;
+    int64_t start = harnessNow();
+    for (; targetsLen < n; targetsLen++) {
+        char *targetArgv[] = {"sleep", "100000", NULL};
+        if (withX) {
+#ifdef HAVE_X11
+            if ((windows[targetsLen] = harnessCreateWindow(h)) == 0) {
+                fprintf(stderr, "Failed to create window\n");
+                cleanReturn(false);
+            }
+#endif
+            harnessWindowArg(windows[targetsLen], target);
+        } else {
+            if ((targetPids[targetsLen] = harnessSpawn(targetArgv)) < 0) {
+                cleanReturn(false);
+            }
+            snprintf(target, sizeof(target), "%d", targetPids[targetsLen]);
+        }
+        char *suspendArgv[] = {(char *)cli, "suspend", target, NULL};
+        char *suspendPidArgv[] = {(char *)cli, "suspend", "--pid", target, NULL};
+        if (harnessRun(withX ? suspendArgv : suspendPidArgv) != 0) {
+            fprintf(stderr, "suspend %zu failed\n", targetsLen);
+            cleanReturn(false);
+        }
+        // The mock blocks if its lines are not read
+        harnessSettle(h, 0);
+    }
+    if (!waitInhibits(h, inhibits + n, 30000)) {
+        fprintf(stderr, "%lu of %zu Inhibit calls received\n", h->inhibits - inhibits, n);
+        cleanReturn(false);
+    }
+    double suspendS = (double)(harnessNow() - start) / 1e9;
+    // Background processes register their status sockets after Inhibit
+    size_t pidsLen = 0;
+    for (int i = 0; i < 500 && (pidsLen = harnessInhibitorPids(h, pids, n + 1)) < n; i++) {
+        usleep(10000);
+    }
+    if (pidsLen != n) {
+        fprintf(stderr, "%zu background processes for %zu inhibitions\n", pidsLen, n);
+        cleanReturn(false);
+    }
+    long rssKb = 0, fds = 0;
+    for (size_t i = 0; i < pidsLen; i++) {
+        long processRssKb = harnessRssKb(pids[i]), processFds = harnessFdCount(pids[i]);
+        if (processRssKb < 0 || processFds < 0) {
+            fprintf(stderr, "Failed to read /proc of %d\n", pids[i]);
+            cleanReturn(false);
+        }
+        rssKb += processRssKb;
+        fds += processFds;
+    }
+    long connections = busConnections(), xClientsNow = xClients(h);
+    printf("N=%zu (%s): suspended in %.2f s\n", n, withX ? "windows" : "--pid", suspendS);
+    printf("  background processes: %zu, RSS %ld kB (%.0f kB each), %ld fds (%.1f each)\n",
+           pidsLen, rssKb, (double)rssKb / (double)n, fds, (double)fds / (double)n);
+    printf("  dbus-daemon: %ld connections (%+ld), RSS %ld kB\n", connections,
+           connections - baseConnections, harnessRssKb(h->dbusPid));
+    if (xClientsNow >= 0) {
+        printf("  X clients: %ld (%+ld)\n", xClientsNow, xClientsNow - baseXClients);
+    }
+    // Release latency of a sample, spread over all inhibitions
+    size_t step = n > SAMPLES ? n / SAMPLES : 1;
+    for (size_t i = 0; i < n && samplesLen < SAMPLES; i += step) {
+        int64_t t0 = harnessNow();
+        if (withX) {
+            harnessWindowArg(windows[i], target);
+            char *resumeArgv[] = {(char *)cli, "resume", target, NULL};
+            if (harnessRun(resumeArgv) != 0) {
+                fprintf(stderr, "resume failed\n");
+                cleanReturn(false);
+            }
+        } else {
+            kill(targetPids[i], SIGKILL);
+        }
+        if (!harnessWaitEvent(h, "uninhibit", 5000, &event)) {
+            fprintf(stderr, "No UnInhibit call\n");
+            cleanReturn(false);
+        }
+        releaseNs[samplesLen++] = event.tsNs - t0;
+    }
+    harnessReport(withX ? "  resume to UnInhibit" : "  exit to UnInhibit", releaseNs,
+                  samplesLen);
+    // Release the rest, by destroying the windows or ending the processes
+    for (size_t i = 0; i < n; i++) {
+#ifdef HAVE_X11
+        if (withX) {
+            harnessDestroyWindow(h, windows[i]);
+            windows[i] = 0;
+        }
+#endif
+        if (targetPids[i] > 0) {
+            kill(targetPids[i], SIGKILL);
+        }
+        harnessSettle(h, 0);
+    }
+    for (int i = 0; i < 3000 && (harnessActive(h) > 0 || harnessInhibitorPids(h, pids, 1) > 0);
+            i++) {
+        harnessSettle(h, 10);
+    }
+    harnessSettle(h, 200);
+    pidsLen = harnessInhibitorPids(h, pids, n + 1);
+    printf("  released: %lu inhibitions left, %lu released twice, %zu processes left\n",
+           harnessActive(h), h->doubleUninhibits - doubleUninhibits, pidsLen);
+    if (harnessActive(h) > 0 || h->doubleUninhibits > doubleUninhibits || pidsLen > 0) {
+        cleanReturn(false);
+    }
+cleanReturn:
+    for (size_t i = 0; i < targetsLen; i++) {
+#ifdef HAVE_X11
+        if (windows[i] != 0) {
+            harnessDestroyWindow(h, windows[i]);
+        }
+#endif
+        if (targetPids[i] > 0) {
+            kill(targetPids[i], SIGKILL);
+            waitpid(targetPids[i], NULL, 0);
+        }
+    }
+    free(releaseNs);
+    free(pids);
+    free(targetPids);
+    free(windows);
+    return returnValue;
+}
+
+int main(int argc, char *argv[]) {
+    struct harness_t h;
+    size_t defaultLevels[] = {10, 100, 1000};
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s XDG_SCREENSAVER MOCK_SCREENSAVER [N...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *cli = argv[1];
+    // Every inhibition holds connections of the bus and of Xvfb, their
+    // descriptor limit is inherited from here
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    // Background processes are reparented to this process
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+    if (!harnessStart(&h, argv[2], 0, true)) {
+        harnessStop(&h);
+        return EXIT_FAILURE;
+    }
+    if (!harnessHasX(&h)) {
+        printf("Xvfb not found, suspending for processes instead of windows\n");
+    }
+    long baseConnections = busConnections(), baseXClients = xClients(&h);
+    bool ok = baseConnections >= 0;
+    size_t levelsLen = argc > 3 ? (size_t)argc - 3
+                                : sizeof(defaultLevels)/sizeof(defaultLevels[0]);
+    for (size_t i = 0; ok && i < levelsLen; i++) {
+        size_t n = argc > 3 ? strtoul(argv[3 + i], NULL, 10) : defaultLevels[i];
+        ok = n > 0 && runLevel(&h, cli, n, baseConnections, baseXClients);
+        // Exited background processes
+        while (waitpid(-1, NULL, WNOHANG) > 0) {}
+    }
+    harnessStop(&h);
+    while (waitpid(-1, NULL, WNOHANG) > 0) {}
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
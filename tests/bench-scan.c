@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Cost of matching /proc/PID/cmdline in the resume scan per process, with
+// matchSuspendCmdline (memcmp of literals including their null byte, windows
+// end where strtoul stops) and with the previous strlen/strcmp implementation
+// as the baseline, and of its parsing steps stripDeletedSuffix (exe links of
+// processes) and parseCmdlineWindow (window arguments)
+//
+// bench-scan [MIN_TIME_MS]
+//
+// Prints ns/op for each command line, exe link and window argument of the
+// corpus and, if the alloc-hooks module is loaded with LD_PRELOAD,
+// allocations per call. Fails if both implementations disagree or if a
+// parsing step returns the wrong result.
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <limits.h>
+#include <time.h>
+#include "xdgss-scan.h"
+
+// Window of the resume that is benchmarked
+#define WINDOW 0x3e00007UL
+
+struct corpusEntry_t {
+    const char *name;
+    const char *argv[72];
+};
+
+// argv of processes that have the same exe as xdg-screensaver and therefore
+// get their command line matched
+const struct corpusEntry_t CORPUS[] = {
+    {"resume", {"xdg-screensaver", "resume", "0x3e00007"}},
+    {"suspend window", {"xdg-screensaver", "suspend", "0x3e00007"}},
+    {"suspend other window", {"xdg-screensaver", "suspend", "0x3e00008"}},
+    {"suspend options", {"xdg-screensaver", "suspend", "--watch-owner", "--fast-teardown",
+                         "0x3e00007"}},
+    {"suspend --pid", {"xdg-screensaver", "suspend", "--pid", "12345"}},
+    {"suspend no window", {"xdg-screensaver", "suspend"}},
+    {"suspend empty window", {"xdg-screensaver", "suspend", ""}},
+    {"suspend invalid window", {"xdg-screensaver", "suspend", "0x3e00007x"}},
+    {"suspend --exec", {"xdg-screensaver", "suspend", "--exec", "--", "mpv", "--fs",
+                        "/home/user/Videos/a-rather-long-file-name-of-a-video.mkv"}},
+    {"long exe path", {"/home/user/.local/share/flatpak/exports/bin/../../app/org.example."
+                       "Application/x86_64/stable/active/files/bin/xdg-screensaver",
+                       "suspend", "0x3e00007"}},
+    {"suspend 64 windows", {"xdg-screensaver", "suspend",
+        "0x1000001", "0x1000002", "0x1000003", "0x1000004", "0x1000005", "0x1000006",
+        "0x1000007", "0x1000008", "0x1000009", "0x100000a", "0x100000b", "0x100000c",
+        "0x100000d", "0x100000e", "0x100000f", "0x1000010", "0x1000011", "0x1000012",
+        "0x1000013", "0x1000014", "0x1000015", "0x1000016", "0x1000017", "0x1000018",
+        "0x1000019", "0x100001a", "0x100001b", "0x100001c", "0x100001d", "0x100001e",
+        "0x100001f", "0x1000020", "0x1000021", "0x1000022", "0x1000023", "0x1000024",
+        "0x1000025", "0x1000026", "0x1000027", "0x1000028", "0x1000029", "0x100002a",
+        "0x100002b", "0x100002c", "0x100002d", "0x100002e", "0x100002f", "0x1000030",
+        "0x1000031", "0x1000032", "0x1000033", "0x1000034", "0x1000035", "0x1000036",
+        "0x1000037", "0x1000038", "0x1000039", "0x100003a", "0x100003b", "0x100003c",
+        "0x100003d", "0x100003e", "0x100003f", "0x3e00007"}}};
+
+struct exeLinkEntry_t {
+    const char *name;
+    const char *exeLink;
+    // Length without " (deleted)"
+    size_t strippedLen;
+};
+
+// Targets of /proc/PID/exe, which are compared with the exe of xdg-screensaver
+const struct exeLinkEntry_t EXE_LINK_CORPUS[] = {
+    {"exe", "/usr/bin/xdg-screensaver", 24},
+    {"exe (deleted)", "/usr/bin/xdg-screensaver (deleted)", 24},
+    {"short exe", "/bin/sh", 7},
+    {"long exe (deleted)", "/home/user/.local/share/flatpak/exports/bin/../../app/org.example."
+                           "Application/x86_64/stable/active/files/bin/xdg-screensaver (deleted)",
+     124},
+    {"suffix only", " (deleted)", 0},
+    {"suffix not at end", "/tmp/a (deleted)/xdg-screensaver", 32}};
+
+struct windowArgEntry_t {
+    const char *name;
+    const char *arg;
+    bool valid;
+    unsigned long window;
+};
+
+// Arguments after "suspend" and its options
+const struct windowArgEntry_t WINDOW_ARG_CORPUS[] = {
+    {"hex window", "0x3e00007", true, 0x3e00007},
+    {"decimal window", "65011719", true, 65011719},
+    {"octal window", "0370000007", true, 0370000007},
+    {"64-bit window", "0xffffffffffffffff", true, 0xffffffffffffffffUL},
+    {"empty", "", false, 0},
+    {"trailing garbage", "0x3e00007x", false, 0},
+    {"option", "--pid", false, 0}};
+
+// Matching of the resume scan before matchSuspendCmdline
+enum cmdlineMatch_t matchStrcmp(const char *cmdline, size_t cmdlineSize, unsigned long window,
+                                size_t *returnWindowsLen) {
+    // check argc >= 1 and argv[1] is "suspend"
+    size_t cmdlineArg1Start = strlen(cmdline) + NULL_BYTE_LEN;
+    if (cmdlineArg1Start >= cmdlineSize ||
+            strcmp(&cmdline[cmdlineArg1Start], "suspend") != 0) {
+        return CMDLINE_MATCH_NONE;
+    }
+    // check argc >= 2 and the remaining arguments are windows (after options)
+    size_t cmdlineArgStart = (
+        cmdlineArg1Start + strlen(&cmdline[cmdlineArg1Start]) + NULL_BYTE_LEN);
+    while (cmdlineArgStart < cmdlineSize &&
+            (strcmp(&cmdline[cmdlineArgStart], "--watch-owner") == 0 ||
+             strcmp(&cmdline[cmdlineArgStart], "--fast-teardown") == 0)) {
+        cmdlineArgStart += strlen(&cmdline[cmdlineArgStart]) + NULL_BYTE_LEN;
+    }
+    size_t windowsLen = 0;
+    bool windowFound = false;
+    for (; cmdlineArgStart < cmdlineSize;
+            cmdlineArgStart += strlen(&cmdline[cmdlineArgStart]) + NULL_BYTE_LEN) {
+        char *windowEnd;
+        unsigned long cmdlineWindow = strtoul(&cmdline[cmdlineArgStart], &windowEnd, 0);
+        if (cmdline[cmdlineArgStart] == '\0' || windowEnd[0] != '\0') {
+            return CMDLINE_MATCH_SUSPEND;
+        }
+        windowsLen++;
+        windowFound = windowFound || cmdlineWindow == window;
+    }
+    *returnWindowsLen = windowsLen;
+    return windowFound ? CMDLINE_MATCH_WINDOW : CMDLINE_MATCH_SUSPEND;
+}
+
+typedef enum cmdlineMatch_t (*matchFunc_t)(const char *, size_t, unsigned long, size_t *);
+
+int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Allocation counter of alloc-hooks (NULL if it's not loaded)
+unsigned long (*allocHooksAllocs)(void);
+
+// Call match on cmdline for at least minTimeNs, returns ns/op
+double measure(matchFunc_t match, const char *cmdline, size_t cmdlineSize,
+               int64_t minTimeNs, double *returnAllocsPerCall) {
+    volatile size_t sink = 0;
+    size_t iterations = 0, batch = 1000;
+    unsigned long allocsStart = allocHooksAllocs != NULL ? allocHooksAllocs() : 0;
+    int64_t start = nowNs(), elapsed;
+    do {
+        for (size_t i = 0; i < batch; i++) {
+            size_t windowsLen = 0;
+            sink += match(cmdline, cmdlineSize, WINDOW, &windowsLen) + windowsLen;
+        }
+        iterations += batch;
+    } while ((elapsed = nowNs() - start) < minTimeNs);
+    (void)sink;
+    if (allocHooksAllocs != NULL) {
+        *returnAllocsPerCall = (double)(allocHooksAllocs() - allocsStart) / (double)iterations;
+    }
+    return (double)elapsed / (double)iterations;
+}
+
+// Call stripDeletedSuffix on exeLink (the space of the suffix is restored after
+// each call) for at least minTimeNs, returns ns/op
+double measureStrip(char *exeLink, size_t exeLinkLen, int64_t minTimeNs,
+                    double *returnAllocsPerCall) {
+    volatile size_t sink = 0;
+    size_t iterations = 0, batch = 1000;
+    unsigned long allocsStart = allocHooksAllocs != NULL ? allocHooksAllocs() : 0;
+    int64_t start = nowNs(), elapsed;
+    do {
+        for (size_t i = 0; i < batch; i++) {
+            size_t len = stripDeletedSuffix(exeLink, exeLinkLen);
+            if (len != exeLinkLen) {
+                exeLink[len] = ' ';
+            }
+            sink += len;
+        }
+        iterations += batch;
+    } while ((elapsed = nowNs() - start) < minTimeNs);
+    (void)sink;
+    if (allocHooksAllocs != NULL) {
+        *returnAllocsPerCall = (double)(allocHooksAllocs() - allocsStart) / (double)iterations;
+    }
+    return (double)elapsed / (double)iterations;
+}
+
+// Call parseCmdlineWindow on arg for at least minTimeNs, returns ns/op
+double measureWindow(const char *arg, int64_t minTimeNs, double *returnAllocsPerCall) {
+    volatile size_t sink = 0;
+    size_t iterations = 0, batch = 1000;
+    unsigned long allocsStart = allocHooksAllocs != NULL ? allocHooksAllocs() : 0;
+    int64_t start = nowNs(), elapsed;
+    do {
+        for (size_t i = 0; i < batch; i++) {
+            unsigned long window = 0;
+            sink += (size_t)(parseCmdlineWindow(arg, &window) != NULL) + window;
+        }
+        iterations += batch;
+    } while ((elapsed = nowNs() - start) < minTimeNs);
+    (void)sink;
+    if (allocHooksAllocs != NULL) {
+        *returnAllocsPerCall = (double)(allocHooksAllocs() - allocsStart) / (double)iterations;
+    }
+    return (double)elapsed / (double)iterations;
+}
+
+void printAllocs(double allocs) {
+    if (allocHooksAllocs != NULL) {
+        printf(" %.2f", allocs);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    int64_t minTimeNs = (argc > 1 ? strtoll(argv[1], NULL, 10) : 200) * 1000000;
+    char cmdline[4096];
+    bool ok = true;
+    *(void **)&allocHooksAllocs = dlsym(RTLD_DEFAULT, "allocHooksAllocs");
+    printf("%-22s %8s %10s %10s %8s %s\n", "cmdline", "bytes", "memcmp", "strcmp", "speedup",
+           allocHooksAllocs != NULL ? "allocs/call" : "");
+    for (size_t i = 0; i < sizeof(CORPUS)/sizeof(CORPUS[0]); i++) {
+        const struct corpusEntry_t *entry = &CORPUS[i];
+        // Arguments separated by null bytes like in /proc/PID/cmdline
+        size_t cmdlineSize = 0;
+        for (const char *const *arg = entry->argv; *arg != NULL; arg++) {
+            size_t argSize = strlen(*arg) + NULL_BYTE_LEN;
+            memcpy(&cmdline[cmdlineSize], *arg, argSize);
+            cmdlineSize += argSize;
+        }
+        size_t windowsLen = 0, baselineWindowsLen = 0;
+        enum cmdlineMatch_t match = matchSuspendCmdline(cmdline, cmdlineSize, WINDOW,
+                                                        &windowsLen);
+        if (match != matchStrcmp(cmdline, cmdlineSize, WINDOW, &baselineWindowsLen) ||
+                windowsLen != baselineWindowsLen) {
+            fprintf(stderr, "Implementations disagree on %s\n", entry->name);
+            ok = false;
+        }
+        double allocs = 0, baselineAllocs = 0;
+        double ns = measure(matchSuspendCmdline, cmdline, cmdlineSize, minTimeNs, &allocs);
+        double baselineNs = measure(matchStrcmp, cmdline, cmdlineSize, minTimeNs,
+                                    &baselineAllocs);
+        printf("%-22s %8zu %7.1f ns %7.1f ns %7.2fx", entry->name, cmdlineSize, ns,
+               baselineNs, baselineNs / ns);
+        if (allocHooksAllocs != NULL) {
+            printf(" %.2f (strcmp %.2f)", allocs, baselineAllocs);
+        }
+        printf("\n");
+    }
+    printf("\n%-22s %8s %10s %s\n", "exe link", "bytes", "strip",
+           allocHooksAllocs != NULL ? "allocs/call" : "");
+    for (size_t i = 0; i < sizeof(EXE_LINK_CORPUS)/sizeof(EXE_LINK_CORPUS[0]); i++) {
+        const struct exeLinkEntry_t *entry = &EXE_LINK_CORPUS[i];
+        char exeLink[PATH_MAX];
+        size_t exeLinkLen = strlen(entry->exeLink);
+        memcpy(exeLink, entry->exeLink, exeLinkLen + NULL_BYTE_LEN);
+        double allocs = 0;
+        double ns = measureStrip(exeLink, exeLinkLen, minTimeNs, &allocs);
+        size_t strippedLen = stripDeletedSuffix(exeLink, exeLinkLen);
+        if (strippedLen != entry->strippedLen || strlen(exeLink) != strippedLen ||
+                memcmp(exeLink, entry->exeLink, strippedLen) != 0) {
+            fprintf(stderr, "stripDeletedSuffix is wrong on %s\n", entry->name);
+            ok = false;
+        }
+        printf("%-22s %8zu %7.1f ns", entry->name, exeLinkLen, ns);
+        printAllocs(allocs);
+    }
+    printf("\n%-22s %8s %10s %s\n", "window argument", "bytes", "parse",
+           allocHooksAllocs != NULL ? "allocs/call" : "");
+    for (size_t i = 0; i < sizeof(WINDOW_ARG_CORPUS)/sizeof(WINDOW_ARG_CORPUS[0]); i++) {
+        const struct windowArgEntry_t *entry = &WINDOW_ARG_CORPUS[i];
+        unsigned long window = 0;
+        const char *argEnd = parseCmdlineWindow(entry->arg, &window);
+        if ((argEnd != NULL) != entry->valid ||
+                (entry->valid && (window != entry->window ||
+                                  argEnd != &entry->arg[strlen(entry->arg)]))) {
+            fprintf(stderr, "parseCmdlineWindow is wrong on %s\n", entry->name);
+            ok = false;
+        }
+        double allocs = 0;
+        double ns = measureWindow(entry->arg, minTimeNs, &allocs);
+        printf("%-22s %8zu %7.1f ns", entry->name, strlen(entry->arg) + NULL_BYTE_LEN, ns);
+        printAllocs(allocs);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Exec-to-exit time of each subcommand of xdg-screensaver
+//
+// bench-startup XDG_SCREENSAVER MOCK_SCREENSAVER LIBXDGSS [ITERATIONS]
+//
+// Every subcommand is measured as installed (libxdgss, libdbus and libX11 are
+// only loaded by the subcommands that need them) and with LIBXDGSS in
+// LD_PRELOAD, which links them at startup like before they were loaded on
+// demand. The difference is the saving of loading on demand. suspend is
+// measured until it returns to the caller (the inhibition is released after
+// each iteration).
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include "harness.h"
+
+enum subcommand_t {
+    SUBCOMMAND_HELP,
+    SUBCOMMAND_VERSION,
+    SUBCOMMAND_RESUME,
+    SUBCOMMAND_LIST,
+    SUBCOMMAND_STATUS,
+    SUBCOMMAND_SUSPEND_PID
+};
+
+const char *SUBCOMMAND_NAMES[] = {
+    [SUBCOMMAND_HELP] = "--help",
+    [SUBCOMMAND_VERSION] = "--version",
+    [SUBCOMMAND_RESUME] = "resume",
+    [SUBCOMMAND_LIST] = "list",
+    [SUBCOMMAND_STATUS] = "status",
+    [SUBCOMMAND_SUSPEND_PID] = "suspend --pid"};
+
+// Run argv with stdout on /dev/null, returns the exit status (-1 on failure)
+int runQuiet(char *const argv[], const char *preload) {
+    pid_t pid;
+    int status;
+    if ((pid = fork()) < 0) {
+        fprintf(stderr, "Failed to fork: %s\n", strerror(errno));
+        return -1;
+    }
+    if (pid == 0) {
+        int nullFd = open("/dev/null", O_WRONLY);
+        if (nullFd >= 0) {
+            dup2(nullFd, STDOUT_FILENO);
+        }
+        if (preload != NULL) {
+            setenv("LD_PRELOAD", preload, true);
+        }
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    if (waitpid(pid, &status, 0) < 0) {
+        return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// Run subcommand iterations times, returns the median in returnP50Ns
+bool measure(struct harness_t *h, const char *cli, enum subcommand_t subcommand,
+             const char *preload, size_t iterations, int64_t *samples, int64_t *returnP50Ns) {
+    char target[32];
+    struct harnessEvent_t event;
+    for (size_t i = 0; i < iterations; i++) {
+        pid_t targetPid = 0;
+        char *argvs[][5] = {
+            [SUBCOMMAND_HELP] = {(char *)cli, "--help", NULL},
+            [SUBCOMMAND_VERSION] = {(char *)cli, "--version", NULL},
+            [SUBCOMMAND_RESUME] = {(char *)cli, "resume", "0x1", NULL},
+            [SUBCOMMAND_LIST] = {(char *)cli, "list", NULL},
+            [SUBCOMMAND_STATUS] = {(char *)cli, "status", NULL},
+            [SUBCOMMAND_SUSPEND_PID] = {(char *)cli, "suspend", "--pid", target, NULL}};
+        if (subcommand == SUBCOMMAND_SUSPEND_PID) {
+            char *targetArgv[] = {"sleep", "1000", NULL};
+            if ((targetPid = harnessSpawn(targetArgv)) < 0) {
+                return false;
+            }
+            snprintf(target, sizeof(target), "%d", targetPid);
+        }
+        int64_t t0 = harnessNow();
+        int status = runQuiet(argvs[subcommand], preload);
+        samples[i] = harnessNow() - t0;
+        if (status != 0) {
+            fprintf(stderr, "%s failed with status %d\n", SUBCOMMAND_NAMES[subcommand], status);
+            if (targetPid > 0) {
+                kill(targetPid, SIGKILL);
+                waitpid(targetPid, NULL, 0);
+            }
+            return false;
+        }
+        if (targetPid > 0) {
+            bool inhibited = harnessWaitEvent(h, "inhibit", 5000, &event);
+            kill(targetPid, SIGKILL);
+            waitpid(targetPid, NULL, 0);
+            if (!inhibited || !harnessWaitEvent(h, "uninhibit", 5000, &event)) {
+                fprintf(stderr, "Inhibition of suspend --pid not held or not released\n");
+                return false;
+            }
+        }
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "  %s", preload != NULL ? "LD_PRELOAD" : "on demand");
+    harnessReport(name, samples, iterations);
+    *returnP50Ns = harnessPercentile(samples, iterations, 50);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    struct harness_t h;
+    if (argc < 4 || argc > 5) {
+        fprintf(stderr, "Usage: %s XDG_SCREENSAVER MOCK_SCREENSAVER LIBXDGSS [ITERATIONS]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *cli = argv[1], *libxdgss = argv[3];
+    size_t iterations = argc > 4 ? strtoul(argv[4], NULL, 10) : 200;
+    int64_t *samples;
+    if (iterations == 0 || (samples = calloc(iterations, sizeof(int64_t))) == NULL) {
+        fprintf(stderr, "Invalid number of iterations\n");
+        return EXIT_FAILURE;
+    }
+    // Background processes of suspend are reparented to this process
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+    if (!harnessStart(&h, argv[2], 0, false)) {
+        harnessStop(&h);
+        free(samples);
+        return EXIT_FAILURE;
+    }
+    // list and status have inhibitors to query
+    char *targetArgv[] = {"sleep", "100000", NULL}, target[32];
+    pid_t targetPid = harnessSpawn(targetArgv);
+    snprintf(target, sizeof(target), "%d", targetPid);
+    char *suspendArgv[] = {(char *)cli, "suspend", "--pid", target, NULL};
+    struct harnessEvent_t event;
+    bool ok = targetPid > 0 && runQuiet(suspendArgv, NULL) == 0 &&
+              harnessWaitEvent(&h, "inhibit", 5000, &event);
+    pid_t inhibitorPid;
+    for (int i = 0; ok && i < 500 && harnessInhibitorPids(&h, &inhibitorPid, 1) == 0; i++) {
+        usleep(10000);
+    }
+    printf("%zu iterations, exec to exit\n", iterations);
+    for (int i = 0; ok && i <= SUBCOMMAND_SUSPEND_PID; i++) {
+        int64_t onDemandNs, preloadNs;
+        printf("%s\n", SUBCOMMAND_NAMES[i]);
+        ok = measure(&h, cli, i, NULL, iterations, samples, &onDemandNs) &&
+             measure(&h, cli, i, libxdgss, iterations, samples, &preloadNs);
+        if (ok) {
+            printf("  saved by loading on demand: %.1f us (p50)\n",
+                   (double)(preloadNs - onDemandNs) / 1e3);
+        }
+        // Background processes of suspend that exited
+        while (waitpid(-1, NULL, WNOHANG) > 0) {}
+    }
+    if (targetPid > 0) {
+        kill(targetPid, SIGKILL);
+    }
+    harnessStop(&h);
+    while (waitpid(-1, NULL, WNOHANG) > 0) {}
+    free(samples);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
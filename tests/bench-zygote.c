@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Suspend latency of "xdg-screensaver suspend WindowID" (cold, exec and
+// dynamic linking for every call) compared with a request to "xdg-screensaver
+// zygote"
+//
+// bench-zygote XDG_SCREENSAVER MOCK_SCREENSAVER [ITERATIONS]
+//
+// Measures until the caller has the reply and until the mock receives
+// Inhibit. Every inhibition is released with "xdg-screensaver resume
+// WindowID", which must reach the children of the zygote as well (fails if
+// UnInhibit doesn't follow). Skipped without Xvfb.
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "harness.h"
+
+#define cleanReturn(value) do { returnValue = value; goto cleanReturn; } while (false)
+
+// Send "suspend WindowID" to the zygote and wait for its reply
+bool zygoteSuspend(const char *socketPath, const char *window) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    char command[64], reply[16];
+    int fd;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socketPath);
+    int commandLen = snprintf(command, sizeof(command), "suspend %s\n", window);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        fprintf(stderr, "Failed to create socket: %s\n", strerror(errno));
+        return false;
+    }
+    ssize_t replyLen = -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+            write(fd, command, (size_t)commandLen) == commandLen) {
+        replyLen = read(fd, reply, sizeof(reply) - 1);
+    }
+    close(fd);
+    if (replyLen < 3 || memcmp(reply, "ok\n", 3) != 0) {
+        fprintf(stderr, "zygote didn't reply ok\n");
+        return false;
+    }
+    return true;
+}
+
+#ifdef HAVE_X11
+// Suspend iterations times (with the zygote if socketPath is not NULL) and
+// release with resume
+bool runMode(struct harness_t *h, const char *cli, const char *socketPath, size_t iterations,
+             int64_t *returnP50Ns) {
+    bool returnValue = true;
+    int64_t *samples = calloc(3 * iterations, sizeof(int64_t));
+    int64_t *suspendNs = samples, *inhibitNs = &samples[iterations],
+            *resumeNs = &samples[2 * iterations];
+    char window[32];
+    struct harnessEvent_t event;
+    if (samples == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    for (size_t i = 0; i < iterations; i++) {
+        unsigned long windowId = harnessCreateWindow(h);
+        harnessWindowArg(windowId, window);
+        char *suspendArgv[] = {(char *)cli, "suspend", window, NULL};
+        char *resumeArgv[] = {(char *)cli, "resume", window, NULL};
+        int64_t t0 = harnessNow();
+        if (socketPath != NULL ? !zygoteSuspend(socketPath, window)
+                               : harnessRun(suspendArgv) != 0) {
+            fprintf(stderr, "suspend failed\n");
+            cleanReturn(false);
+        }
+        suspendNs[i] = harnessNow() - t0;
+        if (!harnessWaitEvent(h, "inhibit", 5000, &event)) {
+            fprintf(stderr, "No Inhibit call\n");
+            cleanReturn(false);
+        }
+        inhibitNs[i] = event.tsNs - t0;
+        int64_t t1 = harnessNow();
+        if (harnessRun(resumeArgv) != 0) {
+            fprintf(stderr, "resume failed\n");
+            cleanReturn(false);
+        }
+        if (!harnessWaitEvent(h, "uninhibit", 5000, &event)) {
+            fprintf(stderr, "No UnInhibit call after resume\n");
+            cleanReturn(false);
+        }
+        resumeNs[i] = event.tsNs - t1;
+        harnessDestroyWindow(h, windowId);
+    }
+    printf("%s\n", socketPath != NULL ? "zygote" : "cold");
+    harnessReport("  suspend", suspendNs, iterations);
+    harnessReport("  suspend to Inhibit", inhibitNs, iterations);
+    harnessReport("  resume to UnInhibit", resumeNs, iterations);
+    *returnP50Ns = harnessPercentile(suspendNs, iterations, 50);
+cleanReturn:
+    free(samples);
+    return returnValue;
+}
+#endif
+
+int main(int argc, char *argv[]) {
+    struct harness_t h;
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr, "Usage: %s XDG_SCREENSAVER MOCK_SCREENSAVER [ITERATIONS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *cli = argv[1];
+    size_t iterations = argc > 3 ? strtoul(argv[3], NULL, 10) : 500;
+    // Children of the zygote are reparented to this process if it exits
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+    if (!harnessStart(&h, argv[2], 0, true)) {
+        harnessStop(&h);
+        return EXIT_FAILURE;
+    }
+    if (!harnessHasX(&h)) {
+        printf("Xvfb not found\n");
+        harnessStop(&h);
+        return HARNESS_SKIP;
+    }
+    int exitStatus = EXIT_FAILURE;
+#ifdef HAVE_X11
+    char socketPath[PATH_MAX];
+    snprintf(socketPath, sizeof(socketPath), "%s/zygote", h.runtimeDir);
+    char *zygoteArgv[] = {(char *)cli, "zygote", "--socket", socketPath, NULL};
+    pid_t zygotePid = harnessSpawn(zygoteArgv);
+    for (int i = 0; i < 500 && access(socketPath, F_OK) != 0; i++) {
+        usleep(10000);
+    }
+    int64_t coldP50Ns = 0, zygoteP50Ns = 0;
+    bool ok = zygotePid > 0 && access(socketPath, F_OK) == 0;
+    if (!ok) {
+        fprintf(stderr, "zygote didn't start\n");
+    }
+    ok = ok && runMode(&h, cli, NULL, iterations, &coldP50Ns) &&
+         runMode(&h, cli, socketPath, iterations, &zygoteP50Ns);
+    if (ok) {
+        printf("zygote suspend is %.1fx faster (p50)\n",
+               (double)coldP50Ns / (double)zygoteP50Ns);
+    }
+    if (zygotePid > 0) {
+        kill(zygotePid, SIGTERM);
+        waitpid(zygotePid, NULL, 0);
+    }
+    exitStatus = ok ? EXIT_SUCCESS : EXIT_FAILURE;
+#endif
+    harnessStop(&h);
+    while (waitpid(-1, NULL, WNOHANG) > 0) {}
+    return exitStatus;
+}
@@ -0,0 +1,505 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <poll.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "harness.h"
+
+#define cleanReturn(value) do { returnValue = value; goto cleanReturn; } while (false)
+
+extern char **environ;
+
+int64_t harnessNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Read one line from fd into line with a buffer for the remaining data
+// (false on timeout, error or EOF)
+bool readLine(int fd, char *buf, size_t *bufLen, size_t bufSize, int timeoutMs,
+              char *line, size_t lineSize) {
+    int64_t deadline = harnessNow() + (int64_t)timeoutMs * 1000000;
+    while (true) {
+        char *lineEnd = memchr(buf, '\n', *bufLen);
+        if (lineEnd != NULL) {
+            size_t lineLen = (size_t)(lineEnd - buf);
+            snprintf(line, lineSize, "%.*s", (int)lineLen, buf);
+            *bufLen -= lineLen + 1;
+            memmove(buf, lineEnd + 1, *bufLen);
+            return true;
+        }
+        if (*bufLen == bufSize) {
+            fprintf(stderr, "Line too long\n");
+            return false;
+        }
+        int64_t remainingMs = (deadline - harnessNow()) / 1000000;
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        if (remainingMs < 0 || poll(&pfd, 1, (int)remainingMs) <= 0) {
+            return false;
+        }
+        ssize_t n = read(fd, &buf[*bufLen], bufSize - *bufLen);
+        if (n <= 0) {
+            return false;
+        }
+        *bufLen += (size_t)n;
+    }
+}
+
+// Start argv with its stdout (or fd 3 if outFd3 is set) connected to a pipe
+pid_t spawnWithPipe(char *const argv[], bool outFd3, int *returnFd) {
+    int fds[2];
+    pid_t pid = -1;
+    posix_spawn_file_actions_t actions;
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        fprintf(stderr, "Failed to create pipe: %s\n", strerror(errno));
+        return -1;
+    }
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], outFd3 ? 3 : STDOUT_FILENO);
+    int err = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (err != 0) {
+        fprintf(stderr, "Failed to start %s: %s\n", argv[0], strerror(err));
+        close(fds[0]);
+        return -1;
+    }
+    *returnFd = fds[0];
+    return pid;
+}
+
+// Search file in PATH
+bool findProgram(const char *file) {
+    const char *path = getenv("PATH");
+    char programPath[PATH_MAX];
+    while (path != NULL) {
+        size_t dirLen = strcspn(path, ":");
+        snprintf(programPath, sizeof(programPath), "%.*s/%s", (int)dirLen, path, file);
+        if (access(programPath, X_OK) == 0) {
+            return true;
+        }
+        path = path[dirLen] != '\0' ? &path[dirLen + 1] : NULL;
+    }
+    return false;
+}
+
+bool startDBus(struct harness_t *h) {
+    char *argv[] = {"dbus-daemon", "--session", "--nofork", "--nopidfile",
+                    "--print-address=3", NULL};
+    char buf[512], address[512];
+    size_t bufLen = 0;
+    int fd;
+    if ((h->dbusPid = spawnWithPipe(argv, true, &fd)) < 0) {
+        h->dbusPid = 0;
+        return false;
+    }
+    bool returnValue = readLine(fd, buf, &bufLen, sizeof(buf), 5000, address, sizeof(address));
+    close(fd);
+    if (!returnValue) {
+        fprintf(stderr, "dbus-daemon didn't print its address\n");
+        return false;
+    }
+    setenv("DBUS_SESSION_BUS_ADDRESS", address, true);
+    return true;
+}
+
+bool startMock(struct harness_t *h, const char *mockPath, unsigned long mockDelayUs) {
+    char delay[32], line[64];
+    snprintf(delay, sizeof(delay), "%lu", mockDelayUs);
+    char *argv[] = {(char *)mockPath, delay, NULL};
+    if ((h->mockPid = spawnWithPipe(argv, false, &h->mockFd)) < 0) {
+        h->mockPid = 0;
+        h->mockFd = -1;
+        return false;
+    }
+    if (!readLine(h->mockFd, h->mockBuf, &h->mockBufLen, sizeof(h->mockBuf), 5000,
+                  line, sizeof(line)) || strcmp(line, "ready") != 0) {
+        fprintf(stderr, "mock-screensaver didn't start\n");
+        return false;
+    }
+    return true;
+}
+
+#ifdef HAVE_X11
+// Start Xvfb if it's installed (false only on errors)
+bool startXvfb(struct harness_t *h) {
+    // Every background process of a window is a client
+    char *argv[] = {"Xvfb", "-displayfd", "3", "-nolisten", "tcp", "-maxclients", "2048",
+                    "-screen", "0", "320x240x24", NULL};
+    char buf[64], displayNumber[32], display[40];
+    size_t bufLen = 0;
+    int fd;
+    if (!findProgram("Xvfb")) {
+        return true;
+    }
+    if ((h->xvfbPid = spawnWithPipe(argv, true, &fd)) < 0) {
+        h->xvfbPid = 0;
+        return false;
+    }
+    bool returnValue = readLine(fd, buf, &bufLen, sizeof(buf), 10000,
+                                displayNumber, sizeof(displayNumber));
+    close(fd);
+    if (!returnValue) {
+        fprintf(stderr, "Xvfb didn't print its display\n");
+        return false;
+    }
+    snprintf(display, sizeof(display), ":%s", displayNumber);
+    setenv("DISPLAY", display, true);
+    if ((h->display = XOpenDisplay(NULL)) == NULL) {
+        fprintf(stderr, "Failed to open X display %s\n", display);
+        return false;
+    }
+    return true;
+}
+#endif
+
+bool harnessStart(struct harness_t *h, const char *mockPath, unsigned long mockDelayUs,
+                  bool withX) {
+    *h = (struct harness_t){.mockFd = -1};
+    snprintf(h->runtimeDir, sizeof(h->runtimeDir), "/tmp/xdgss-harness-XXXXXX");
+    if (mkdtemp(h->runtimeDir) == NULL) {
+        fprintf(stderr, "Failed to create runtime directory: %s\n", strerror(errno));
+        h->runtimeDir[0] = '\0';
+        return false;
+    }
+    setenv("XDG_RUNTIME_DIR", h->runtimeDir, true);
+    unsetenv("XDGSS_TRACE");
+    unsetenv("DISPLAY");
+    // Background processes of xdg-screensaver must not keep the pipes open
+    signal(SIGPIPE, SIG_IGN);
+    if (!startDBus(h) || !startMock(h, mockPath, mockDelayUs)) {
+        return false;
+    }
+#ifdef HAVE_X11
+    if (withX && !startXvfb(h)) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+bool harnessAttach(struct harness_t *h, int mockFd) {
+    *h = (struct harness_t){.mockFd = mockFd};
+#ifdef HAVE_X11
+    if (getenv("DISPLAY") != NULL && (h->display = XOpenDisplay(NULL)) == NULL) {
+        fprintf(stderr, "Failed to open X display\n");
+        return false;
+    }
+#endif
+    return true;
+}
+
+void harnessDetach(struct harness_t *h) {
+#ifdef HAVE_X11
+    if (h->display != NULL) {
+        XCloseDisplay(h->display);
+    }
+#endif
+    *h = (struct harness_t){.mockFd = -1};
+}
+
+int removeEntry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    remove(path);
+    return 0;
+}
+
+void stopProcess(pid_t pid) {
+    if (pid > 0) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+}
+
+size_t harnessInhibitorPids(const struct harness_t *h, pid_t *returnPids, size_t pidsSize) {
+    char path[PATH_MAX];
+    size_t pidsLen = 0;
+    // Status sockets are named by PID
+    snprintf(path, sizeof(path), "%s/xdg-screensaver-shim/inhibitors", h->runtimeDir);
+    DIR *dir;
+    if (h->runtimeDir[0] == '\0' || (dir = opendir(path)) == NULL) {
+        return 0;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && pidsLen < pidsSize) {
+        if (entry->d_name[0] != '.') {
+            returnPids[pidsLen++] = (pid_t)atoi(entry->d_name);
+        }
+    }
+    closedir(dir);
+    return pidsLen;
+}
+
+void harnessStop(struct harness_t *h) {
+    // Leftover background processes, they release their inhibitions before
+    // the mock is stopped (exited processes remove their status sockets, so
+    // more than pids are found in several rounds)
+    pid_t pids[1024];
+    size_t pidsLen;
+    for (int round = 0; round < 64 &&
+            (pidsLen = harnessInhibitorPids(h, pids, sizeof(pids)/sizeof(pids[0]))) > 0;
+            round++) {
+        for (size_t i = 0; i < pidsLen; i++) {
+            int pidFd = (int)syscall(SYS_pidfd_open, pids[i], 0);
+            kill(pids[i], SIGTERM);
+            if (pidFd >= 0) {
+                // Readable when the process exited (not necessarily reaped)
+                struct pollfd fd = {.fd = pidFd, .events = POLLIN};
+                poll(&fd, 1, 2000);
+                close(pidFd);
+            }
+        }
+    }
+#ifdef HAVE_X11
+    if (h->display != NULL) {
+        XCloseDisplay(h->display);
+        h->display = NULL;
+    }
+#endif
+    stopProcess(h->xvfbPid);
+    stopProcess(h->mockPid);
+    stopProcess(h->dbusPid);
+    if (h->mockFd != -1) {
+        close(h->mockFd);
+    }
+    if (h->runtimeDir[0] != '\0') {
+        nftw(h->runtimeDir, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+    *h = (struct harness_t){.mockFd = -1};
+}
+
+bool harnessHasX(const struct harness_t *h) {
+#ifdef HAVE_X11
+    return h->display != NULL;
+#else
+    return false;
+#endif
+}
+
+bool harnessNextEvent(struct harness_t *h, int timeoutMs, struct harnessEvent_t *returnEvent) {
+    char line[128];
+    if (!readLine(h->mockFd, h->mockBuf, &h->mockBufLen, sizeof(h->mockBuf), timeoutMs,
+                  line, sizeof(line))) {
+        return false;
+    }
+    if (sscanf(line, "%15s %u %" SCNd64, returnEvent->type, &returnEvent->cookie,
+               &returnEvent->tsNs) != 3) {
+        fprintf(stderr, "Unexpected line of mock-screensaver: %s\n", line);
+        return false;
+    }
+    if (strcmp(returnEvent->type, "inhibit") == 0) {
+        h->inhibits++;
+    } else if (strcmp(returnEvent->type, "uninhibit") == 0) {
+        h->uninhibits++;
+    } else {
+        h->doubleUninhibits++;
+    }
+    return true;
+}
+
+bool harnessWaitEvent(struct harness_t *h, const char *type, int timeoutMs,
+                      struct harnessEvent_t *returnEvent) {
+    int64_t deadline = harnessNow() + (int64_t)timeoutMs * 1000000;
+    while (harnessNextEvent(h, (int)((deadline - harnessNow()) / 1000000), returnEvent)) {
+        if (strcmp(returnEvent->type, type) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void harnessSettle(struct harness_t *h, int quietMs) {
+    struct harnessEvent_t event;
+    while (harnessNextEvent(h, quietMs, &event)) {
+        // Only counted
+    }
+}
+
+unsigned long harnessActive(const struct harness_t *h) {
+    return h->inhibits - h->uninhibits;
+}
+
+pid_t harnessSpawn(char *const argv[]) {
+    pid_t pid;
+    int err = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+    if (err != 0) {
+        fprintf(stderr, "Failed to start %s: %s\n", argv[0], strerror(err));
+        return -1;
+    }
+    return pid;
+}
+
+int harnessRun(char *const argv[]) {
+    pid_t pid;
+    int status;
+    if ((pid = harnessSpawn(argv)) < 0) {
+        return -1;
+    }
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "Failed to wait for %s: %s\n", argv[0], strerror(errno));
+            return -1;
+        }
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+void harnessWindowArg(unsigned long window, char returnArg[32]) {
+    snprintf(returnArg, 32, "%#lx", window);
+}
+
+#ifdef HAVE_X11
+unsigned long harnessCreateWindow(struct harness_t *h) {
+    Window window = XCreateSimpleWindow(h->display, DefaultRootWindow(h->display),
+                                        0, 0, 1, 1, 0, 0, 0);
+    // Must exist before xdg-screensaver selects its events
+    XSync(h->display, False);
+    return window;
+}
+
+void harnessDestroyWindow(struct harness_t *h, unsigned long window) {
+    XDestroyWindow(h->display, window);
+    XFlush(h->display);
+}
+#endif
+
+// Value of field (e.g. "VmRSS:") in a /proc file of pid
+long procField(pid_t pid, const char *file, const char *field) {
+    char path[64], line[256];
+    long value = -1;
+    snprintf(path, sizeof(path), "/proc/%d/%s", pid, file);
+    FILE *f;
+    if ((f = fopen(path, "re")) == NULL) {
+        return -1;
+    }
+    size_t fieldLen = strlen(field);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, field, fieldLen) == 0) {
+            value = strtol(&line[fieldLen], NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return value;
+}
+
+long harnessRssKb(pid_t pid) {
+    return procField(pid, "status", "VmRSS:");
+}
+
+long harnessPssKb(pid_t pid) {
+    return procField(pid, "smaps_rollup", "Pss:");
+}
+
+long harnessFdCount(pid_t pid) {
+    char path[64];
+    long count = 0;
+    snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+    DIR *dir;
+    if ((dir = opendir(path)) == NULL) {
+        return -1;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            count++;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+int compareSamples(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+int64_t harnessPercentile(const int64_t *samples, size_t samplesLen, double p) {
+    if (samplesLen == 0) {
+        return 0;
+    }
+    size_t i = (size_t)(p / 100 * (double)(samplesLen - 1) + 0.5);
+    return samples[i < samplesLen ? i : samplesLen - 1];
+}
+
+void harnessReport(const char *name, int64_t *samples, size_t samplesLen) {
+    qsort(samples, samplesLen, sizeof(int64_t), compareSamples);
+    printf("%-28s n=%-6zu p50=%9.1f p90=%9.1f p99=%9.1f max=%9.1f us\n", name, samplesLen,
+           (double)harnessPercentile(samples, samplesLen, 50) / 1000,
+           (double)harnessPercentile(samples, samplesLen, 90) / 1000,
+           (double)harnessPercentile(samples, samplesLen, 99) / 1000,
+           (double)harnessPercentile(samples, samplesLen, 100) / 1000);
+}
+
+bool harnessAllocDelta(const char *reportPath, pid_t pid, const char *fromEvent,
+                       const char *toEvent, struct harnessAllocs_t *returnDelta) {
+    char line[256], event[64];
+    int linePid;
+    struct harnessAllocs_t from = {0}, current;
+    bool fromFound = false;
+    FILE *f;
+    if ((f = fopen(reportPath, "re")) == NULL) {
+        fprintf(stderr, "Failed to open %s: %s\n", reportPath, strerror(errno));
+        return false;
+    }
+    *returnDelta = (struct harnessAllocs_t){0};
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "%d %63s %lu %lu %ld %ld", &linePid, event, &current.allocs,
+                   &current.bytes, &current.live, &current.peak) != 6 ||
+                (pid != 0 && linePid != pid)) {
+            continue;
+        }
+        if (!fromFound) {
+            if (strcmp(event, fromEvent) == 0) {
+                from = current;
+                fromFound = true;
+            }
+            continue;
+        }
+        if (current.peak - from.live > returnDelta->peak) {
+            returnDelta->peak = current.peak - from.live;
+        }
+        if (strcmp(event, toEvent) == 0) {
+            returnDelta->allocs = current.allocs - from.allocs;
+            returnDelta->bytes = current.bytes - from.bytes;
+            returnDelta->live = current.live - from.live;
+            fclose(f);
+            return true;
+        }
+    }
+    fclose(f);
+    fprintf(stderr, "No %s after %s in %s\n", toEvent, fromEvent, reportPath);
+    return false;
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Environment for the tests and benchmarks: a private XDG_RUNTIME_DIR, a
+// private session bus with mock-screensaver and Xvfb (if requested and
+// installed)
+
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "project-config.h"
+#ifdef HAVE_X11
+#include <X11/Xlib.h>
+#endif
+
+// Exit status that marks a meson test as skipped
+#define HARNESS_SKIP 77
+
+struct harness_t {
+    char runtimeDir[64];
+    pid_t dbusPid, mockPid, xvfbPid;
+    // Lines written by mock-screensaver
+    int mockFd;
+    char mockBuf[4096];
+    size_t mockBufLen;
+    // Calls of the mock read so far
+    unsigned long inhibits, uninhibits, doubleUninhibits;
+#ifdef HAVE_X11
+    Display *display;
+#endif
+};
+
+struct harnessEvent_t {
+    // "inhibit", "uninhibit" or "double"
+    char type[16];
+    unsigned int cookie;
+    int64_t tsNs;
+};
+
+// Start the bus and mock-screensaver (replying after mockDelayUs) and, if
+// withX is set, Xvfb (check harnessHasX, it's optional)
+bool harnessStart(struct harness_t *h, const char *mockPath, unsigned long mockDelayUs,
+                  bool withX);
+
+// Stop everything, background processes of xdg-screensaver that are still
+// registered in the runtime directory are killed
+void harnessStop(struct harness_t *h);
+
+// Use the environment of a harness that was started by the parent process
+// (the mock's lines are read from the inherited mockFd)
+bool harnessAttach(struct harness_t *h, int mockFd);
+
+// Close the connections of harnessAttach without stopping anything
+void harnessDetach(struct harness_t *h);
+
+bool harnessHasX(const struct harness_t *h);
+
+// CLOCK_MONOTONIC in nanoseconds (same clock as the mock and XDGSS_TRACE)
+int64_t harnessNow();
+
+// Read the next call of the mock (false on timeout)
+bool harnessNextEvent(struct harness_t *h, int timeoutMs, struct harnessEvent_t *returnEvent);
+
+// Read calls of the mock until one of type (false on timeout)
+bool harnessWaitEvent(struct harness_t *h, const char *type, int timeoutMs,
+                      struct harnessEvent_t *returnEvent);
+
+// Read calls of the mock until there are none for quietMs
+void harnessSettle(struct harness_t *h, int quietMs);
+
+// Inhibitions of the mock that are still active
+unsigned long harnessActive(const struct harness_t *h);
+
+// Run argv (searched in PATH) and wait for it, returns the exit status (-1
+// on failure)
+int harnessRun(char *const argv[]);
+
+// Start argv (searched in PATH) without waiting (-1 on failure)
+pid_t harnessSpawn(char *const argv[]);
+
+// Format window for the command line
+void harnessWindowArg(unsigned long window, char returnArg[32]);
+
+#ifdef HAVE_X11
+// Create an unmapped window on Xvfb (0 on failure)
+unsigned long harnessCreateWindow(struct harness_t *h);
+
+void harnessDestroyWindow(struct harness_t *h, unsigned long window);
+#endif
+
+// PIDs of the background processes with status sockets (at most pidsSize)
+size_t harnessInhibitorPids(const struct harness_t *h, pid_t *returnPids, size_t pidsSize);
+
+// Resource usage of process pid in kB (-1 if unknown)
+long harnessRssKb(pid_t pid);
+long harnessPssKb(pid_t pid);
+// Number of open file descriptors of process pid (-1 if unknown)
+long harnessFdCount(pid_t pid);
+
+// Print percentiles of samples (in nanoseconds, sorted in place) in
+// microseconds
+void harnessReport(const char *name, int64_t *samples, size_t samplesLen);
+
+// Percentile p (0-100) of sorted samples
+int64_t harnessPercentile(const int64_t *samples, size_t samplesLen, double p);
+
+// Allocations of a program with the alloc-hooks module in LD_PRELOAD
+struct harnessAllocs_t {
+    unsigned long allocs, bytes;
+    // Change of the heap usage and the highest heap usage over the start
+    long live, peak;
+};
+
+// Allocations between the first trace event fromEvent and the next toEvent
+// (of process pid or of all processes if it's 0) according to the report of
+// alloc-hooks
+bool harnessAllocDelta(const char *reportPath, pid_t pid, const char *fromEvent,
+                       const char *toEvent, struct harnessAllocs_t *returnDelta);
+
+#endif
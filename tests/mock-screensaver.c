@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Mock of org.freedesktop.ScreenSaver on the session bus for the harnesses
+//
+// mock-screensaver [DELAY_US]
+//
+// Replies to Inhibit and UnInhibit after DELAY_US microseconds and writes one
+// line per call to stdout: "inhibit COOKIE TS_NS", "uninhibit COOKIE TS_NS" or
+// "double COOKIE TS_NS" for UnInhibit of a cookie that is not inhibiting (TS_NS
+// is CLOCK_MONOTONIC when the call was received). "ready" is written once the
+// name is owned.
+//
+// With MOCK_SYSTEMD_CGROUP set to a directory in a cgroup2 hierarchy, it also
+// mocks StartTransientUnit and AttachProcessesToUnit of the user's service
+// manager on org.freedesktop.systemd1 for scopes, which are cgroups in the
+// directory (scopes without members are treated as removed), with the signal
+// JobRemoved of the job that starts a scope.
+
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <dbus/dbus.h>
+
+struct mockData_t {
+    // Cookies are handed out in order starting with 1
+    bool *inhibiting;
+    size_t inhibitingSize;
+    dbus_uint32_t nextCookie;
+    unsigned long delayUs;
+    // cgroup of the mocked service manager (NULL if it's not mocked)
+    const char *systemdCgroup;
+    unsigned long jobs;
+} mockData = {.nextCookie = 1};
+
+uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+bool reply(DBusConnection *conn, DBusMessage *msg, int firstArgType, ...) {
+    DBusMessage *replyMsg;
+    if ((replyMsg = dbus_message_new_method_return(msg)) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    va_list ap;
+    va_start(ap, firstArgType);
+    bool returnValue = dbus_message_append_args_valist(replyMsg, firstArgType, ap) &&
+                       dbus_connection_send(conn, replyMsg, NULL);
+    va_end(ap);
+    dbus_message_unref(replyMsg);
+    return returnValue;
+}
+
+bool replyError(DBusConnection *conn, DBusMessage *msg, const char *name, const char *message) {
+    DBusMessage *errorMsg;
+    if ((errorMsg = dbus_message_new_error(msg, name, message)) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    dbus_connection_send(conn, errorMsg, NULL);
+    dbus_message_unref(errorMsg);
+    return true;
+}
+
+// Check if the scope unit has members
+bool scopeActive(const char *unit) {
+    struct mockData_t *d = &mockData;
+    char path[PATH_MAX];
+    int pid;
+    snprintf(path, sizeof(path), "%s/%s/cgroup.procs", d->systemdCgroup, unit);
+    FILE *procsFile;
+    if ((procsFile = fopen(path, "re")) == NULL) {
+        return false;
+    }
+    bool active = fscanf(procsFile, "%d", &pid) == 1;
+    fclose(procsFile);
+    return active;
+}
+
+// Move the processes into the scope unit
+bool moveToScope(const char *unit, const dbus_uint32_t *pids, int pidsLen) {
+    struct mockData_t *d = &mockData;
+    char path[PATH_MAX], pidStr[16];
+    int fd;
+    snprintf(path, sizeof(path), "%s/%s/cgroup.procs", d->systemdCgroup, unit);
+    if ((fd = open(path, O_WRONLY | O_CLOEXEC)) < 0) {
+        return false;
+    }
+    bool returnValue = true;
+    for (int i = 0; returnValue && i < pidsLen; i++) {
+        int pidStrLen = snprintf(pidStr, sizeof(pidStr), "%" PRIu32, pids[i]);
+        returnValue = write(fd, pidStr, (size_t)pidStrLen) == pidStrLen;
+    }
+    close(fd);
+    return returnValue;
+}
+
+bool handleSystemdMessage(DBusConnection *conn, DBusMessage *msg) {
+    struct mockData_t *d = &mockData;
+    const char *unit = NULL;
+    if (dbus_message_is_method_call(msg, "org.freedesktop.systemd1.Manager",
+                                    "AttachProcessesToUnit")) {
+        const char *subcgroup;
+        dbus_uint32_t *pids;
+        int pidsLen;
+        if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &unit, DBUS_TYPE_STRING,
+                                   &subcgroup, DBUS_TYPE_ARRAY, DBUS_TYPE_UINT32, &pids,
+                                   &pidsLen, DBUS_TYPE_INVALID)) {
+            return replyError(conn, msg, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+        }
+        if (!scopeActive(unit)) {
+            return replyError(conn, msg, "org.freedesktop.systemd1.NoSuchUnit", unit);
+        }
+        if (!moveToScope(unit, pids, pidsLen)) {
+            return replyError(conn, msg, DBUS_ERROR_ACCESS_DENIED, strerror(errno));
+        }
+        return reply(conn, msg, DBUS_TYPE_INVALID);
+    }
+    // StartTransientUnit(s name, s mode, a(sv) properties, a(sa(sv)) aux),
+    // only the property PIDs is used
+    DBusMessageIter iter, propertiesIter;
+    if (!dbus_message_iter_init(msg, &iter) ||
+            dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_STRING) {
+        return replyError(conn, msg, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+    }
+    dbus_message_iter_get_basic(&iter, &unit);
+    if (!dbus_message_iter_next(&iter) || !dbus_message_iter_next(&iter) ||
+            dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY) {
+        return replyError(conn, msg, DBUS_ERROR_INVALID_ARGS, "Invalid arguments");
+    }
+    if (scopeActive(unit)) {
+        return replyError(conn, msg, "org.freedesktop.systemd1.UnitExists", unit);
+    }
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", d->systemdCgroup, unit);
+    if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+        return replyError(conn, msg, DBUS_ERROR_ACCESS_DENIED, strerror(errno));
+    }
+    dbus_uint32_t *pids = NULL;
+    int pidsLen = 0;
+    dbus_message_iter_recurse(&iter, &propertiesIter);
+    for (; dbus_message_iter_get_arg_type(&propertiesIter) == DBUS_TYPE_STRUCT;
+            dbus_message_iter_next(&propertiesIter)) {
+        DBusMessageIter structIter, variantIter, arrayIter;
+        const char *name;
+        dbus_message_iter_recurse(&propertiesIter, &structIter);
+        dbus_message_iter_get_basic(&structIter, &name);
+        dbus_message_iter_next(&structIter);
+        dbus_message_iter_recurse(&structIter, &variantIter);
+        if (strcmp(name, "PIDs") != 0 ||
+                dbus_message_iter_get_arg_type(&variantIter) != DBUS_TYPE_ARRAY) {
+            continue;
+        }
+        dbus_message_iter_recurse(&variantIter, &arrayIter);
+        dbus_message_iter_get_fixed_array(&arrayIter, &pids, &pidsLen);
+    }
+    // Like systemd, the processes are moved by the job after the reply and
+    // JobRemoved is emitted when it finished
+    dbus_uint32_t jobId = (dbus_uint32_t)++d->jobs;
+    char job[64];
+    const char *jobPtr = job, *result = "done";
+    snprintf(job, sizeof(job), "/org/freedesktop/systemd1/job/%" PRIu32, jobId);
+    if (!reply(conn, msg, DBUS_TYPE_OBJECT_PATH, &jobPtr, DBUS_TYPE_INVALID)) {
+        return false;
+    }
+    dbus_connection_flush(conn);
+    if (pidsLen > 0 && !moveToScope(unit, pids, pidsLen)) {
+        result = "failed";
+    }
+    DBusMessage *signalMsg;
+    if ((signalMsg = dbus_message_new_signal("/org/freedesktop/systemd1",
+                                             "org.freedesktop.systemd1.Manager",
+                                             "JobRemoved")) == NULL ||
+            !dbus_message_append_args(signalMsg, DBUS_TYPE_UINT32, &jobId, DBUS_TYPE_OBJECT_PATH,
+                                      &jobPtr, DBUS_TYPE_STRING, &unit, DBUS_TYPE_STRING,
+                                      &result, DBUS_TYPE_INVALID) ||
+            !dbus_connection_send(conn, signalMsg, NULL)) {
+        fprintf(stderr, "Out of memory\n");
+        if (signalMsg != NULL) {
+            dbus_message_unref(signalMsg);
+        }
+        return false;
+    }
+    dbus_message_unref(signalMsg);
+    return true;
+}
+
+bool handleMessage(DBusConnection *conn, DBusMessage *msg) {
+    struct mockData_t *d = &mockData;
+    uint64_t ts = nowNs();
+    if (d->systemdCgroup != NULL &&
+            (dbus_message_is_method_call(msg, "org.freedesktop.systemd1.Manager",
+                                         "AttachProcessesToUnit") ||
+             dbus_message_is_method_call(msg, "org.freedesktop.systemd1.Manager",
+                                         "StartTransientUnit"))) {
+        return handleSystemdMessage(conn, msg);
+    }
+    if (dbus_message_is_method_call(msg, "org.freedesktop.ScreenSaver", "Inhibit")) {
+        if (d->nextCookie >= d->inhibitingSize) {
+            size_t size = d->inhibitingSize > 0 ? d->inhibitingSize * 2 : 1024;
+            bool *inhibiting;
+            if ((inhibiting = realloc(d->inhibiting, size * sizeof(bool))) == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                return false;
+            }
+            memset(&inhibiting[d->inhibitingSize], 0, (size - d->inhibitingSize) * sizeof(bool));
+            d->inhibiting = inhibiting;
+            d->inhibitingSize = size;
+        }
+        dbus_uint32_t cookie = d->nextCookie++;
+        d->inhibiting[cookie] = true;
+        usleep((useconds_t)d->delayUs);
+        // The line is written after the reply is flushed, the caller isn't
+        // waiting for the reply anymore when the harness reads it
+        if (!reply(conn, msg, DBUS_TYPE_UINT32, &cookie, DBUS_TYPE_INVALID)) {
+            return false;
+        }
+        dbus_connection_flush(conn);
+        printf("inhibit %" PRIu32 " %" PRIu64 "\n", cookie, ts);
+        return true;
+    }
+    if (dbus_message_is_method_call(msg, "org.freedesktop.ScreenSaver", "UnInhibit")) {
+        dbus_uint32_t cookie = 0;
+        if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_UINT32, &cookie, DBUS_TYPE_INVALID)) {
+            cookie = 0;
+        }
+        bool inhibiting = cookie < d->inhibitingSize && d->inhibiting[cookie];
+        if (inhibiting) {
+            d->inhibiting[cookie] = false;
+        }
+        usleep((useconds_t)d->delayUs);
+        if (!reply(conn, msg, DBUS_TYPE_INVALID)) {
+            return false;
+        }
+        dbus_connection_flush(conn);
+        printf("%s %" PRIu32 " %" PRIu64 "\n", inhibiting ? "uninhibit" : "double", cookie, ts);
+        return true;
+    }
+    if (dbus_message_get_type(msg) == DBUS_MESSAGE_TYPE_METHOD_CALL &&
+            !dbus_message_get_no_reply(msg)) {
+        return replyError(conn, msg, DBUS_ERROR_UNKNOWN_METHOD, "Not implemented by the mock");
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    struct mockData_t *d = &mockData;
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [DELAY_US]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    d->delayUs = argc == 2 ? strtoul(argv[1], NULL, 10) : 0;
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    DBusError err;
+    dbus_error_init(&err);
+    DBusConnection *conn;
+    if ((conn = dbus_bus_get_private(DBUS_BUS_SESSION, &err)) == NULL) {
+        fprintf(stderr, "Failed to connect to session bus: %s\n", err.message);
+        return EXIT_FAILURE;
+    }
+    if (dbus_bus_request_name(conn, "org.freedesktop.ScreenSaver",
+                              DBUS_NAME_FLAG_DO_NOT_QUEUE, &err) !=
+            DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+        fprintf(stderr, "Failed to own org.freedesktop.ScreenSaver: %s\n",
+                dbus_error_is_set(&err) ? err.message : "name taken");
+        return EXIT_FAILURE;
+    }
+    d->systemdCgroup = getenv("MOCK_SYSTEMD_CGROUP");
+    if (d->systemdCgroup != NULL &&
+            dbus_bus_request_name(conn, "org.freedesktop.systemd1", DBUS_NAME_FLAG_DO_NOT_QUEUE,
+                                  &err) != DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+        fprintf(stderr, "Failed to own org.freedesktop.systemd1: %s\n",
+                dbus_error_is_set(&err) ? err.message : "name taken");
+        return EXIT_FAILURE;
+    }
+    printf("ready\n");
+    while (dbus_connection_read_write(conn, -1)) {
+        DBusMessage *msg;
+        while ((msg = dbus_connection_pop_message(conn)) != NULL) {
+            bool ok = handleMessage(conn, msg);
+            dbus_message_unref(msg);
+            if (!ok) {
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,702 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Replay the invocations recorded with XDGSS_TRACE against mock-screensaver
+// and Xvfb
+//
+// replay XDG_SCREENSAVER MOCK_SCREENSAVER TRACE [SPEED]
+//
+// The workload is read from the trace: suspend_begin and suspend_window are
+// the invocations of suspend (windows, --pid or --exec, with their options),
+// suspend_end links the background process to its invocation, finish_begin
+// ends it (destroyed windows, exited processes or signals) and resume_begin
+// is an invocation of resume. It's replayed with the same timing divided by
+// SPEED (default 1). Recorded windows and processes are replaced by new
+// windows on Xvfb and by sleep processes. Inhibitions that ended by a signal
+// without a recorded resume of their window are ended with resume (--pid:
+// by the exit of the process). Invocations for windows are skipped without
+// Xvfb.
+//
+// Reports the recorded workload, how late the invocations started, the
+// latency of suspend and resume as seen by the caller and the peak number of
+// concurrent inhibitions. Fails if an invocation fails or if an inhibition is
+// left active or released twice after everything was released.
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include "harness.h"
+#include "xdgss.h"
+
+#define cleanReturn(value) do { returnValue = value; goto cleanReturn; } while (false)
+
+enum invocationMode_t {
+    MODE_WINDOWS,
+    MODE_PID,
+    MODE_EXEC
+};
+
+struct invocation_t {
+    enum invocationMode_t mode;
+    // Caller and background process (0 until it's forked)
+    pid_t pid, childPid;
+    int64_t beginNs, endNs; // endNs is -1 if it didn't end in the trace
+    unsigned int flags;
+    pid_t target;
+    unsigned long *windows;
+    size_t windowsLen, windowsSize;
+    // Failed before forking, not replayed
+    bool failed;
+};
+
+enum actionType_t {
+    ACTION_SUSPEND,
+    ACTION_RESUME,
+    ACTION_DESTROY,
+    ACTION_EXIT
+};
+
+struct action_t {
+    int64_t offsetNs;
+    enum actionType_t type;
+    size_t invocation; // ACTION_SUSPEND
+    unsigned long window; // ACTION_RESUME and ACTION_DESTROY (recorded window)
+    pid_t target; // ACTION_EXIT (recorded PID)
+    size_t order;
+};
+
+struct traceLine_t {
+    int64_t tsNs;
+    pid_t pid;
+    char event[32];
+    char *line;
+    size_t order;
+};
+
+struct workload_t {
+    struct invocation_t *invocations;
+    size_t invocationsLen, invocationsSize;
+    struct action_t *actions;
+    size_t actionsLen, actionsSize;
+    size_t resumes;
+    int64_t startNs, endNs;
+};
+
+// Recorded windows and processes and their replacements
+struct mapping_t {
+    unsigned long recorded, replayed; // replayed is 0 if it was destroyed
+};
+
+// Invocations of xdg-screensaver that are running
+struct running_t {
+    pid_t pid;
+    enum actionType_t type;
+    // suspend --exec waits for its command, its latency is not recorded
+    bool measured;
+    int64_t startNs;
+};
+
+struct replay_t {
+    struct harness_t *h;
+    const char *cli;
+    double speed;
+    struct mapping_t *windows, *targets;
+    size_t windowsLen, targetsLen;
+    struct running_t *running;
+    size_t runningLen;
+    int64_t *lagNs, *suspendNs, *resumeNs;
+    size_t lagLen, suspendLen, resumeLen;
+    size_t skipped, failed;
+    unsigned long peakActive;
+};
+
+// Make room for one more element in *array
+bool grow(void **array, size_t *size, size_t len, size_t elementSize) {
+    if (len < *size) {
+        return true;
+    }
+    size_t newSize = *size > 0 ? 2 * *size : 64;
+    void *newArray = reallocarray(*array, newSize, elementSize);
+    if (newArray == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    *array = newArray;
+    *size = newSize;
+    return true;
+}
+
+// Start of the value of the JSON member key in line (NULL if it's missing)
+const char *jsonValue(const char *line, const char *key) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char *value = strstr(line, pattern);
+    return value != NULL ? value + strlen(pattern) : NULL;
+}
+
+long long jsonInt(const char *line, const char *key, long long defaultValue) {
+    const char *value = jsonValue(line, key);
+    return value != NULL ? strtoll(value, NULL, 10) : defaultValue;
+}
+
+// Copy the string member key of line (empty if it's missing)
+void jsonString(const char *line, const char *key, char *returnValue, size_t size) {
+    const char *value = jsonValue(line, key);
+    const char *valueEnd;
+    returnValue[0] = '\0';
+    if (value != NULL && value[0] == '"' && (valueEnd = strchr(&value[1], '"')) != NULL &&
+            (size_t)(valueEnd - value) <= size) {
+        memcpy(returnValue, &value[1], (size_t)(valueEnd - value) - 1);
+        returnValue[valueEnd - value - 1] = '\0';
+    }
+}
+
+int compareTraceLines(const void *a, const void *b) {
+    const struct traceLine_t *x = a, *y = b;
+    if (x->tsNs != y->tsNs) {
+        return x->tsNs < y->tsNs ? -1 : 1;
+    }
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+int compareActions(const void *a, const void *b) {
+    const struct action_t *x = a, *y = b;
+    if (x->offsetNs != y->offsetNs) {
+        return x->offsetNs < y->offsetNs ? -1 : 1;
+    }
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+int compareInt64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+bool addAction(struct workload_t *w, struct action_t action) {
+    if (!grow((void **)&w->actions, &w->actionsSize, w->actionsLen, sizeof(struct action_t))) {
+        return false;
+    }
+    action.order = w->actionsLen;
+    w->actions[w->actionsLen++] = action;
+    return true;
+}
+
+// Latest invocation of the caller pid that didn't fork (NULL if none)
+struct invocation_t *findCaller(struct workload_t *w, pid_t pid) {
+    for (size_t i = w->invocationsLen; i > 0; i--) {
+        struct invocation_t *inv = &w->invocations[i - 1];
+        if (inv->pid == pid && inv->childPid == 0 && inv->endNs < 0 && !inv->failed) {
+            return inv;
+        }
+    }
+    return NULL;
+}
+
+// Actions for the end of inv at tsNs
+bool endInvocation(struct workload_t *w, struct invocation_t *inv, const char *reason,
+                   int64_t tsNs) {
+    inv->endNs = tsNs;
+    if (inv->mode == MODE_EXEC || strcmp(reason, "error") == 0) {
+        return true;
+    }
+    if (inv->mode == MODE_PID) {
+        // A signal other than from resume (which doesn't know PIDs), ended
+        // like an exit of the process
+        return addAction(w, (struct action_t){.offsetNs = tsNs, .type = ACTION_EXIT,
+                                              .target = inv->target});
+    }
+    bool resumed = false;
+    for (size_t i = 0; i < w->actionsLen && strcmp(reason, "signal") == 0; i++) {
+        for (size_t j = 0; j < inv->windowsLen; j++) {
+            resumed = resumed || (w->actions[i].type == ACTION_RESUME &&
+                                  w->actions[i].window == inv->windows[j] &&
+                                  w->actions[i].offsetNs >= inv->beginNs);
+        }
+    }
+    for (size_t j = 0; j < inv->windowsLen && !resumed; j++) {
+        // "exited" is the owner of the window with --watch-owner
+        enum actionType_t type = strcmp(reason, "signal") == 0 ? ACTION_RESUME : ACTION_DESTROY;
+        if (!addAction(w, (struct action_t){.offsetNs = tsNs, .type = type,
+                                            .window = inv->windows[j]})) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool handleTraceLine(struct workload_t *w, const struct traceLine_t *l) {
+    char value[32];
+    struct invocation_t *inv;
+    if (strcmp(l->event, "suspend_begin") == 0) {
+        if (!grow((void **)&w->invocations, &w->invocationsSize, w->invocationsLen,
+                  sizeof(struct invocation_t))) {
+            return false;
+        }
+        inv = &w->invocations[w->invocationsLen++];
+        *inv = (struct invocation_t){.pid = l->pid, .beginNs = l->tsNs, .endNs = -1};
+        inv->flags = (unsigned int)jsonInt(l->line, "flags", 0);
+        inv->target = (pid_t)jsonInt(l->line, "target", 0);
+        jsonString(l->line, "mode", value, sizeof(value));
+        inv->mode = strcmp(value, "exec") == 0 ? MODE_EXEC
+                    : inv->target != 0 ? MODE_PID : MODE_WINDOWS;
+        if (inv->mode == MODE_EXEC) {
+            inv->childPid = l->pid; // doesn't fork
+        }
+    } else if (strcmp(l->event, "suspend_window") == 0) {
+        if ((inv = findCaller(w, l->pid)) == NULL) {
+            return true;
+        }
+        if (!grow((void **)&inv->windows, &inv->windowsSize, inv->windowsLen,
+                  sizeof(unsigned long))) {
+            return false;
+        }
+        inv->windows[inv->windowsLen++] = (unsigned long)jsonInt(l->line, "window", 0);
+    } else if (strcmp(l->event, "suspend_end") == 0) {
+        if ((inv = findCaller(w, (pid_t)jsonInt(l->line, "parent", 0))) != NULL) {
+            inv->childPid = l->pid;
+        }
+    } else if (strcmp(l->event, "resume_begin") == 0) {
+        w->resumes++;
+        return addAction(w, (struct action_t){
+            .offsetNs = l->tsNs, .type = ACTION_RESUME,
+            .window = (unsigned long)jsonInt(l->line, "window", 0)});
+    } else if (strcmp(l->event, "finish_begin") == 0) {
+        jsonString(l->line, "reason", value, sizeof(value));
+        for (size_t i = w->invocationsLen; i > 0; i--) {
+            inv = &w->invocations[i - 1];
+            if (inv->endNs >= 0 || inv->failed) {
+                continue;
+            }
+            if (inv->mode == MODE_EXEC && inv->pid == l->pid && strcmp(value, "error") == 0) {
+                inv->failed = true;
+                return true;
+            }
+            if (inv->childPid == l->pid) {
+                return endInvocation(w, inv, value, l->tsNs);
+            }
+            if (inv->childPid == 0 && inv->pid == l->pid) {
+                inv->failed = true;
+                return true;
+            }
+        }
+    }
+    return true;
+}
+
+// Read the trace at path into w
+bool loadWorkload(const char *path, struct workload_t *w) {
+    bool returnValue = true;
+    struct traceLine_t *lines = NULL;
+    size_t linesLen = 0, linesSize = 0;
+    char *line = NULL;
+    size_t lineSize = 0;
+    FILE *file;
+    *w = (struct workload_t){0};
+    if ((file = fopen(path, "re")) == NULL) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    while (getline(&line, &lineSize, file) >= 0) {
+        struct traceLine_t l = {.order = linesLen};
+        l.tsNs = jsonInt(line, "ts_ns", -1);
+        l.pid = (pid_t)jsonInt(line, "pid", 0);
+        jsonString(line, "event", l.event, sizeof(l.event));
+        if (l.tsNs < 0 || l.event[0] == '\0') {
+            continue; // truncated or not a trace line
+        }
+        if (!grow((void **)&lines, &linesSize, linesLen, sizeof(struct traceLine_t)) ||
+                (l.line = strdup(line)) == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            cleanReturn(false);
+        }
+        lines[linesLen++] = l;
+    }
+    // Processes append to the trace concurrently
+    qsort(lines, linesLen, sizeof(struct traceLine_t), compareTraceLines);
+    for (size_t i = 0; i < linesLen; i++) {
+        if (!handleTraceLine(w, &lines[i])) {
+            cleanReturn(false);
+        }
+    }
+    for (size_t i = 0; i < w->invocationsLen; i++) {
+        if (!w->invocations[i].failed &&
+                !addAction(w, (struct action_t){.offsetNs = w->invocations[i].beginNs,
+                                                .type = ACTION_SUSPEND, .invocation = i})) {
+            cleanReturn(false);
+        }
+    }
+    if (w->actionsLen == 0) {
+        fprintf(stderr, "No invocations in %s\n", path);
+        cleanReturn(false);
+    }
+    qsort(w->actions, w->actionsLen, sizeof(struct action_t), compareActions);
+    w->startNs = w->actions[0].offsetNs;
+    w->endNs = linesLen > 0 ? lines[linesLen - 1].tsNs : w->startNs;
+    for (size_t i = 0; i < w->actionsLen; i++) {
+        w->actions[i].offsetNs -= w->startNs;
+    }
+cleanReturn:
+    for (size_t i = 0; i < linesLen; i++) {
+        free(lines[i].line);
+    }
+    free(lines);
+    free(line);
+    fclose(file);
+    return returnValue;
+}
+
+void freeWorkload(struct workload_t *w) {
+    for (size_t i = 0; i < w->invocationsLen; i++) {
+        free(w->invocations[i].windows);
+    }
+    free(w->invocations);
+    free(w->actions);
+}
+
+// Highest number of recorded inhibitions at the same time
+size_t recordedPeak(const struct workload_t *w) {
+    size_t peak = 0, active = 0, beginsLen = 0, endsLen = 0;
+    int64_t *begins = calloc(w->invocationsLen + 1, sizeof(int64_t)),
+            *ends = calloc(w->invocationsLen + 1, sizeof(int64_t));
+    if (begins == NULL || ends == NULL) {
+        free(begins);
+        free(ends);
+        return 0;
+    }
+    for (size_t i = 0; i < w->invocationsLen; i++) {
+        if (!w->invocations[i].failed) {
+            begins[beginsLen++] = w->invocations[i].beginNs;
+            if (w->invocations[i].endNs >= 0) {
+                ends[endsLen++] = w->invocations[i].endNs;
+            }
+        }
+    }
+    qsort(begins, beginsLen, sizeof(int64_t), compareInt64);
+    qsort(ends, endsLen, sizeof(int64_t), compareInt64);
+    for (size_t i = 0, j = 0; i < beginsLen; i++) {
+        for (; j < endsLen && ends[j] <= begins[i]; j++) {
+            active--;
+        }
+        if (++active > peak) {
+            peak = active;
+        }
+    }
+    free(begins);
+    free(ends);
+    return peak;
+}
+
+// Replacement of a recorded window or process (0 if there is none)
+unsigned long *findMapping(struct mapping_t *mappings, size_t mappingsLen,
+                           unsigned long recorded) {
+    for (size_t i = mappingsLen; i > 0; i--) {
+        if (mappings[i - 1].recorded == recorded) {
+            return &mappings[i - 1].replayed;
+        }
+    }
+    return NULL;
+}
+
+// Replacement of a recorded window or process, a new one is created if there
+// is none (0 on failure)
+unsigned long mapOrCreate(struct replay_t *r, bool window, unsigned long recorded) {
+    struct mapping_t **mappings = window ? &r->windows : &r->targets;
+    size_t *mappingsLen = window ? &r->windowsLen : &r->targetsLen;
+    unsigned long *replayed = findMapping(*mappings, *mappingsLen, recorded);
+    if (replayed != NULL && *replayed != 0) {
+        return *replayed;
+    }
+    unsigned long created = 0;
+    if (window) {
+#ifdef HAVE_X11
+        created = harnessCreateWindow(r->h);
+#endif
+    } else {
+        char *targetArgv[] = {"sleep", "1000000", NULL};
+        pid_t pid = harnessSpawn(targetArgv);
+        created = pid > 0 ? (unsigned long)pid : 0;
+    }
+    if (created == 0) {
+        return 0;
+    }
+    if (replayed != NULL) {
+        *replayed = created;
+        return created;
+    }
+    // Mappings are only appended, sized with the actions
+    (*mappings)[(*mappingsLen)++] = (struct mapping_t){.recorded = recorded,
+                                                       .replayed = created};
+    return created;
+}
+
+// Start an invocation of xdg-screensaver without waiting for it
+bool startCli(struct replay_t *r, enum actionType_t type, bool measured,
+              char *const argv[]) {
+    pid_t pid = harnessSpawn(argv);
+    if (pid < 0) {
+        r->failed++;
+        return false;
+    }
+    r->running[r->runningLen++] = (struct running_t){.pid = pid, .type = type,
+                                                     .measured = measured,
+                                                     .startNs = harnessNow()};
+    return true;
+}
+
+// Reap exited processes and read the calls of the mock for at most waitMs
+void pump(struct replay_t *r, int waitMs) {
+    struct harnessEvent_t event;
+    int64_t deadline = harnessNow() + (int64_t)waitMs * 1000000;
+    do {
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (size_t i = 0; i < r->runningLen; i++) {
+                if (r->running[i].pid != pid) {
+                    continue;
+                }
+                int64_t elapsedNs = harnessNow() - r->running[i].startNs;
+                if (r->running[i].measured && r->running[i].type == ACTION_SUSPEND) {
+                    r->suspendNs[r->suspendLen++] = elapsedNs;
+                } else if (r->running[i].measured) {
+                    r->resumeNs[r->resumeLen++] = elapsedNs;
+                }
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    r->failed++;
+                }
+                r->running[i] = r->running[--r->runningLen];
+                break;
+            }
+        }
+        int64_t remainingMs = (deadline - harnessNow()) / 1000000;
+        // Exited children don't wake up the read
+        remainingMs = remainingMs < 0 ? 0 : remainingMs > 10 ? 10 : remainingMs;
+        if (harnessNextEvent(r->h, (int)remainingMs, &event) &&
+                harnessActive(r->h) > r->peakActive) {
+            r->peakActive = harnessActive(r->h);
+        }
+    } while (harnessNow() < deadline);
+}
+
+bool replayAction(struct replay_t *r, const struct workload_t *w, const struct action_t *a) {
+    char arg[32], durationArg[32];
+    unsigned long *replayed;
+    if (a->type == ACTION_SUSPEND) {
+        const struct invocation_t *inv = &w->invocations[a->invocation];
+        char *argv[8 + inv->windowsLen];
+        size_t argvLen = 0;
+        char (*windowArgs)[32] = calloc(inv->windowsLen + 1, sizeof(*windowArgs));
+        if (windowArgs == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return false;
+        }
+        argv[argvLen++] = (char *)r->cli;
+        argv[argvLen++] = "suspend";
+        if (inv->mode == MODE_EXEC) {
+            int64_t durationNs = (inv->endNs >= 0 ? inv->endNs : w->endNs) - inv->beginNs;
+            snprintf(durationArg, sizeof(durationArg), "%.3f",
+                     (double)durationNs / 1e9 / r->speed);
+            argv[argvLen++] = "--exec";
+            argv[argvLen++] = "--";
+            argv[argvLen++] = "sleep";
+            argv[argvLen++] = durationArg;
+        } else {
+            if (inv->flags & XDGSS_NO_REPLY) {
+                argv[argvLen++] = "--fast-teardown";
+            }
+            if (inv->mode == MODE_PID) {
+                pid_t target = (pid_t)mapOrCreate(r, false, (unsigned long)inv->target);
+                if (target == 0) {
+                    free(windowArgs);
+                    r->failed++;
+                    return true;
+                }
+                snprintf(arg, sizeof(arg), "%d", target);
+                argv[argvLen++] = "--pid";
+                argv[argvLen++] = arg;
+            } else if (!harnessHasX(r->h) || inv->windowsLen == 0) {
+                free(windowArgs);
+                r->skipped++;
+                return true;
+            } else {
+                if (inv->flags & XDGSS_WATCH_OWNER) {
+                    argv[argvLen++] = "--watch-owner";
+                }
+                for (size_t i = 0; i < inv->windowsLen; i++) {
+                    harnessWindowArg(mapOrCreate(r, true, inv->windows[i]), windowArgs[i]);
+                    argv[argvLen++] = windowArgs[i];
+                }
+            }
+        }
+        argv[argvLen] = NULL;
+        startCli(r, ACTION_SUSPEND, inv->mode != MODE_EXEC, argv);
+        free(windowArgs);
+    } else if (a->type == ACTION_RESUME) {
+        if (!harnessHasX(r->h)) {
+            return true;
+        }
+        // Resume of a window that isn't inhibited scans /proc all the same
+        harnessWindowArg(mapOrCreate(r, true, a->window), arg);
+        char *argv[] = {(char *)r->cli, "resume", arg, NULL};
+        startCli(r, ACTION_RESUME, true, argv);
+    } else if (a->type == ACTION_DESTROY) {
+        replayed = findMapping(r->windows, r->windowsLen, a->window);
+#ifdef HAVE_X11
+        if (replayed != NULL && *replayed != 0) {
+            harnessDestroyWindow(r->h, *replayed);
+            *replayed = 0;
+        }
+#endif
+    } else {
+        replayed = findMapping(r->targets, r->targetsLen, (unsigned long)a->target);
+        if (replayed != NULL && *replayed != 0) {
+            kill((pid_t)*replayed, SIGKILL);
+            *replayed = 0;
+        }
+    }
+    return true;
+}
+
+// Release everything that is left and wait until the inhibitions are gone
+void releaseAll(struct replay_t *r) {
+    for (size_t i = 0; i < r->targetsLen; i++) {
+        if (r->targets[i].replayed != 0) {
+            kill((pid_t)r->targets[i].replayed, SIGKILL);
+            r->targets[i].replayed = 0;
+        }
+    }
+#ifdef HAVE_X11
+    for (size_t i = 0; i < r->windowsLen; i++) {
+        if (r->windows[i].replayed != 0) {
+            harnessDestroyWindow(r->h, r->windows[i].replayed);
+            r->windows[i].replayed = 0;
+        }
+    }
+#endif
+    pid_t pids[1];
+    for (int i = 0; i < 1000 && (r->runningLen > 0 || harnessActive(r->h) > 0 ||
+                                 harnessInhibitorPids(r->h, pids, 1) > 0); i++) {
+        pump(r, 10);
+    }
+    pump(r, 200);
+}
+
+bool replay(struct harness_t *h, const char *cli, const struct workload_t *w, double speed) {
+    bool returnValue = true;
+    struct replay_t r = {.h = h, .cli = cli, .speed = speed};
+    size_t n = w->actionsLen;
+    // Every action maps at most all windows of its invocation
+    size_t mappingsSize = n;
+    for (size_t i = 0; i < w->invocationsLen; i++) {
+        mappingsSize += w->invocations[i].windowsLen;
+    }
+    r.windows = calloc(mappingsSize, sizeof(struct mapping_t));
+    r.targets = calloc(n, sizeof(struct mapping_t));
+    r.running = calloc(n, sizeof(struct running_t));
+    r.lagNs = calloc(n, sizeof(int64_t));
+    r.suspendNs = calloc(n, sizeof(int64_t));
+    r.resumeNs = calloc(n, sizeof(int64_t));
+    if (r.windows == NULL || r.targets == NULL || r.running == NULL || r.lagNs == NULL ||
+            r.suspendNs == NULL || r.resumeNs == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+    unsigned long inhibits = h->inhibits, uninhibits = h->uninhibits,
+                  doubleUninhibits = h->doubleUninhibits;
+    int64_t start = harnessNow();
+    for (size_t i = 0; i < n; i++) {
+        int64_t due = start + (int64_t)((double)w->actions[i].offsetNs / speed), now;
+        while ((now = harnessNow()) < due) {
+            pump(&r, (int)((due - now + 999999) / 1000000));
+        }
+        r.lagNs[r.lagLen++] = harnessNow() - due;
+        if (!replayAction(&r, w, &w->actions[i])) {
+            cleanReturn(false);
+        }
+        pump(&r, 0);
+    }
+    double elapsedS = (double)(harnessNow() - start) / 1e9;
+    releaseAll(&r);
+    unsigned long left = harnessActive(h), doubled = h->doubleUninhibits - doubleUninhibits;
+    printf("replayed at %gx in %.1f s, %zu invocations failed, %zu skipped (Xvfb not found)\n",
+           speed, elapsedS, r.failed, r.skipped);
+    harnessReport("  start delay", r.lagNs, r.lagLen);
+    harnessReport("  suspend", r.suspendNs, r.suspendLen);
+    if (r.resumeLen > 0) {
+        harnessReport("  resume", r.resumeNs, r.resumeLen);
+    }
+    printf("peak %lu concurrent inhibitions, %lu Inhibit and %lu UnInhibit calls, "
+           "%lu left active, %lu released twice\n", r.peakActive, h->inhibits - inhibits,
+           h->uninhibits - uninhibits, left, doubled);
+    if (r.failed > 0 || left > 0 || doubled > 0) {
+        cleanReturn(false);
+    }
+cleanReturn:
+    free(r.resumeNs);
+    free(r.suspendNs);
+    free(r.lagNs);
+    free(r.running);
+    free(r.targets);
+    free(r.windows);
+    return returnValue;
+}
+
+int main(int argc, char *argv[]) {
+    struct harness_t h;
+    struct workload_t w;
+    if (argc < 4 || argc > 5) {
+        fprintf(stderr, "Usage: %s XDG_SCREENSAVER MOCK_SCREENSAVER TRACE [SPEED]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *cli = argv[1];
+    double speed = argc > 4 ? strtod(argv[4], NULL) : 1;
+    if (!(speed > 0)) {
+        fprintf(stderr, "Invalid speed: %s\n", argv[4]);
+        return EXIT_FAILURE;
+    }
+    if (!loadWorkload(argv[3], &w)) {
+        return EXIT_FAILURE;
+    }
+    size_t modes[3] = {0}, failed = 0;
+    for (size_t i = 0; i < w.invocationsLen; i++) {
+        modes[w.invocations[i].mode]++;
+        failed += w.invocations[i].failed;
+    }
+    printf("recorded: %zu suspend (%zu windows, %zu --pid, %zu --exec, %zu failed) and %zu "
+           "resume over %.1f s, peak %zu concurrent inhibitions\n", w.invocationsLen,
+           modes[MODE_WINDOWS], modes[MODE_PID], modes[MODE_EXEC], failed, w.resumes,
+           (double)(w.endNs - w.startNs) / 1e9, recordedPeak(&w));
+    // Background processes are reparented to this process
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+    if (!harnessStart(&h, argv[2], 0, true)) {
+        harnessStop(&h);
+        freeWorkload(&w);
+        return EXIT_FAILURE;
+    }
+    bool ok = replay(&h, cli, &w, speed);
+    harnessStop(&h);
+    while (waitpid(-1, NULL, WNOHANG) > 0) {}
+    freeWorkload(&w);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
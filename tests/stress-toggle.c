@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Throughput of "xdg-screensaver suspend WindowID" directly followed by
+// "xdg-screensaver resume WindowID"
+//
+// stress-toggle XDG_SCREENSAVER MOCK_SCREENSAVER [SECONDS] [WORKERS]
+//
+// Toggles the same window, toggles different windows and toggles different
+// windows from WORKERS concurrent processes, each for SECONDS. Reports
+// toggles per second, the latency of the commands as seen by the caller and
+// fails if an inhibition is left active (leaked cookie) or released twice.
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "harness.h"
+
+#define cleanReturn(value) do { returnValue = value; goto cleanReturn; } while (false)
+
+// Windows that are toggled in turn
+#define WINDOWS_PER_WORKER 16
+#define MAX_WORKERS 64
+// Samples of each worker (further toggles are counted only)
+#define MAX_SAMPLES 200000
+
+// Written by the workers, shared with the parent
+struct workerResult_t {
+    size_t toggles, failures, samplesLen;
+    int64_t suspendNs[MAX_SAMPLES], resumeNs[MAX_SAMPLES];
+};
+
+// Toggle windows in turn until deadline
+void runWorker(const char *cli, const unsigned long *windows, size_t windowsLen,
+               int64_t deadline, struct workerResult_t *result) {
+    char window[32];
+    for (size_t i = 0; harnessNow() < deadline; i++) {
+        harnessWindowArg(windows[i % windowsLen], window);
+        char *suspendArgv[] = {(char *)cli, "suspend", window, NULL};
+        char *resumeArgv[] = {(char *)cli, "resume", window, NULL};
+        int64_t t0 = harnessNow();
+        int suspendStatus = harnessRun(suspendArgv);
+        int64_t t1 = harnessNow();
+        int resumeStatus = harnessRun(resumeArgv);
+        int64_t t2 = harnessNow();
+        if (suspendStatus != 0 || resumeStatus != 0) {
+            result->failures++;
+            continue;
+        }
+        if (result->samplesLen < MAX_SAMPLES) {
+            result->suspendNs[result->samplesLen] = t1 - t0;
+            result->resumeNs[result->samplesLen] = t2 - t1;
+            result->samplesLen++;
+        }
+        result->toggles++;
+    }
+}
+
+// Run workersLen workers (in this process if it's 0) for seconds and report
+bool runScenario(struct harness_t *h, const char *cli, const char *name,
+                 const unsigned long *windows, size_t windowsPerWorker, size_t workersLen,
+                 unsigned int seconds) {
+    bool returnValue = true;
+    size_t processes = workersLen > 0 ? workersLen : 1;
+    size_t resultsSize = processes * sizeof(struct workerResult_t);
+    struct workerResult_t *results;
+    int64_t *samples = NULL;
+    if ((results = mmap(NULL, resultsSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+        fprintf(stderr, "Failed to map memory: %s\n", strerror(errno));
+        return false;
+    }
+    unsigned long inhibits = h->inhibits, uninhibits = h->uninhibits,
+                  doubleUninhibits = h->doubleUninhibits;
+    int64_t start = harnessNow(), deadline = start + (int64_t)seconds * 1000000000;
+    if (workersLen == 0) {
+        // The mock blocks if its lines are not read
+        while (harnessNow() < deadline) {
+            runWorker(cli, windows, windowsPerWorker,
+                      harnessNow() + 100000000 < deadline ? harnessNow() + 100000000
+                                                          : deadline, results);
+            harnessSettle(h, 0);
+        }
+    } else {
+        for (size_t i = 0; i < workersLen; i++) {
+            pid_t pid;
+            if ((pid = fork()) < 0) {
+                fprintf(stderr, "Failed to fork: %s\n", strerror(errno));
+                cleanReturn(false);
+            }
+            if (pid == 0) {
+                runWorker(cli, &windows[i * windowsPerWorker], windowsPerWorker, deadline,
+                          &results[i]);
+                _exit(EXIT_SUCCESS);
+            }
+        }
+        size_t running = workersLen;
+        while (running > 0) {
+            harnessSettle(h, 10);
+            while (running > 0 && waitpid(-1, NULL, WNOHANG) > 0) {
+                running--;
+            }
+        }
+    }
+    double elapsed = (double)(harnessNow() - start) / 1e9;
+    // Background processes that were still releasing
+    harnessSettle(h, 1000);
+    size_t toggles = 0, failures = 0, samplesLen = 0;
+    for (size_t i = 0; i < processes; i++) {
+        toggles += results[i].toggles;
+        failures += results[i].failures;
+        samplesLen += results[i].samplesLen;
+    }
+    if ((samples = calloc(samplesLen > 0 ? 2 * samplesLen : 1, sizeof(int64_t))) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+    int64_t *suspendNs = samples, *resumeNs = &samples[samplesLen];
+    for (size_t i = 0, j = 0; i < processes; i++) {
+        memcpy(&suspendNs[j], results[i].suspendNs, results[i].samplesLen * sizeof(int64_t));
+        memcpy(&resumeNs[j], results[i].resumeNs, results[i].samplesLen * sizeof(int64_t));
+        j += results[i].samplesLen;
+    }
+    unsigned long leaked = (h->inhibits - inhibits) - (h->uninhibits - uninhibits),
+                  doubled = h->doubleUninhibits - doubleUninhibits;
+    printf("%s: %.0f toggles/s (%zu toggles, %zu failed), %lu leaked, %lu released twice\n",
+           name, (double)toggles / elapsed, toggles, failures, leaked, doubled);
+    harnessReport("  suspend", suspendNs, samplesLen);
+    harnessReport("  resume", resumeNs, samplesLen);
+    if (failures > 0 || leaked > 0 || doubled > 0) {
+        cleanReturn(false);
+    }
+cleanReturn:
+    free(samples);
+    munmap(results, resultsSize);
+    return returnValue;
+}
+
+int main(int argc, char *argv[]) {
+    struct harness_t h;
+    if (argc < 3 || argc > 5) {
+        fprintf(stderr, "Usage: %s XDG_SCREENSAVER MOCK_SCREENSAVER [SECONDS] [WORKERS]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *cli = argv[1];
+    unsigned int seconds = argc > 3 ? (unsigned int)strtoul(argv[3], NULL, 10) : 5;
+    size_t workersLen = argc > 4 ? strtoul(argv[4], NULL, 10) : 4;
+    if (workersLen < 1 || workersLen > MAX_WORKERS) {
+        fprintf(stderr, "WORKERS must be between 1 and %d\n", MAX_WORKERS);
+        return EXIT_FAILURE;
+    }
+    if (!harnessStart(&h, argv[2], 0, true)) {
+        harnessStop(&h);
+        return EXIT_FAILURE;
+    }
+    if (!harnessHasX(&h)) {
+        printf("Xvfb not found\n");
+        harnessStop(&h);
+        return HARNESS_SKIP;
+    }
+    int exitStatus = EXIT_FAILURE;
+#ifdef HAVE_X11
+    unsigned long windows[MAX_WORKERS * WINDOWS_PER_WORKER];
+    size_t windowsLen = workersLen * WINDOWS_PER_WORKER;
+    for (size_t i = 0; i < windowsLen; i++) {
+        if ((windows[i] = harnessCreateWindow(&h)) == 0) {
+            fprintf(stderr, "Failed to create window\n");
+            goto stop;
+        }
+    }
+    bool ok = runScenario(&h, cli, "same window", windows, 1, 0, seconds);
+    ok = runScenario(&h, cli, "different windows", windows, WINDOWS_PER_WORKER, 0,
+                     seconds) && ok;
+    char name[64];
+    snprintf(name, sizeof(name), "%zu concurrent workers", workersLen);
+    ok = runScenario(&h, cli, name, windows, WINDOWS_PER_WORKER, workersLen, seconds) && ok;
+    exitStatus = ok ? EXIT_SUCCESS : EXIT_FAILURE;
+stop:
+#endif
+    harnessStop(&h);
+    return exitStatus;
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Heap allocations, allocated bytes and peak heap usage of suspend and
+// resume, fails if they exceed the limits below
+//
+// test-alloc XDG_SCREENSAVER MOCK_SCREENSAVER ALLOC_HOOKS
+//
+// The resume scan must not allocate per process: it's measured with and
+// without additional processes of xdg-screensaver (zygotes, their command
+// lines are read) and other processes in /proc.
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <limits.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include "harness.h"
+
+// Processes started for the resume scan, half of them zygotes
+#define EXTRA_PROCESSES 100
+
+// Raise deliberately (with the reason in the commit message) if an
+// operation needs more
+struct allocLimit_t {
+    const char *operation;
+    unsigned long maxAllocs;
+    long maxPeak;
+} ALLOC_LIMITS[] = {
+    // From suspend_begin to suspend_end, mostly libdbus (connecting and the
+    // Inhibit call) and loading libxdgss
+    {"suspend", 250, 48 * 1024},
+    // From resume_begin to resume_end, independent of the number of processes
+    // (the peak is the buffer of opendir)
+    {"resume", 8, 48 * 1024},
+    {"resume (busy /proc)", 8, 48 * 1024},
+    {NULL}};
+
+bool checkLimit(const char *operation, const struct harnessAllocs_t *allocs) {
+    printf("%-20s allocations=%-5lu bytes=%-7lu peak=%ld\n", operation, allocs->allocs,
+           allocs->bytes, allocs->peak);
+    for (struct allocLimit_t *limit = ALLOC_LIMITS; limit->operation != NULL; limit++) {
+        if (strcmp(limit->operation, operation) == 0) {
+            if (allocs->allocs > limit->maxAllocs || allocs->peak > limit->maxPeak) {
+                fprintf(stderr, "%s exceeds the limit of %lu allocations and %ld bytes peak\n",
+                        operation, limit->maxAllocs, limit->maxPeak);
+                return false;
+            }
+            return true;
+        }
+    }
+    fprintf(stderr, "No limit for %s\n", operation);
+    return false;
+}
+
+// Run argv with the allocator interposer and tracing, the report is written to
+// reportPath
+int runCounted(struct harness_t *h, char *const argv[], const char *allocHooks,
+               const char *reportPath) {
+    char tracePath[PATH_MAX];
+    snprintf(tracePath, sizeof(tracePath), "%s/trace", h->runtimeDir);
+    unlink(reportPath);
+    setenv("XDGSS_TRACE", tracePath, true);
+    setenv("ALLOC_HOOKS_REPORT", reportPath, true);
+    setenv("LD_PRELOAD", allocHooks, true);
+    int status = harnessRun(argv);
+    unsetenv("LD_PRELOAD");
+    unsetenv("ALLOC_HOOKS_REPORT");
+    unsetenv("XDGSS_TRACE");
+    return status;
+}
+
+bool measureResume(struct harness_t *h, const char *cli, const char *allocHooks,
+                   const char *operation, struct harnessAllocs_t *returnAllocs) {
+    char reportPath[PATH_MAX];
+    snprintf(reportPath, sizeof(reportPath), "%s/allocs-resume", h->runtimeDir);
+    char *resumeArgv[] = {(char *)cli, "resume", "0x1", NULL};
+    if (runCounted(h, resumeArgv, allocHooks, reportPath) != 0) {
+        fprintf(stderr, "resume failed\n");
+        return false;
+    }
+    return harnessAllocDelta(reportPath, 0, "resume_begin", "resume_end", returnAllocs) &&
+           checkLimit(operation, returnAllocs);
+}
+
+int main(int argc, char *argv[]) {
+    struct harness_t h;
+    char reportPath[PATH_MAX], targetArg[16], socketPath[PATH_MAX];
+    pid_t extraPids[EXTRA_PROCESSES];
+    size_t extraPidsLen = 0;
+    struct harnessAllocs_t allocs, idleResume, busyResume;
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s XDG_SCREENSAVER MOCK_SCREENSAVER ALLOC_HOOKS\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *cli = argv[1], *allocHooks = argv[3];
+    // Background processes are reparented to this process
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+    if (!harnessStart(&h, argv[2], 0, false)) {
+        harnessStop(&h);
+        return EXIT_FAILURE;
+    }
+    int exitStatus = EXIT_FAILURE;
+    // Suspend
+    char *targetArgv[] = {"sleep", "1000", NULL};
+    pid_t targetPid = harnessSpawn(targetArgv);
+    snprintf(targetArg, sizeof(targetArg), "%d", targetPid);
+    snprintf(reportPath, sizeof(reportPath), "%s/allocs-suspend", h.runtimeDir);
+    char *suspendArgv[] = {(char *)cli, "suspend", "--pid", targetArg, NULL};
+    struct harnessEvent_t event;
+    if (runCounted(&h, suspendArgv, allocHooks, reportPath) != 0 ||
+            !harnessWaitEvent(&h, "inhibit", 5000, &event)) {
+        fprintf(stderr, "suspend failed\n");
+        goto stop;
+    }
+    // suspend_end is written by the background process
+    pid_t backgroundPid = 0;
+    for (int i = 0; i < 500 && harnessInhibitorPids(&h, &backgroundPid, 1) == 0; i++) {
+        usleep(10000);
+    }
+    bool ok = harnessAllocDelta(reportPath, 0, "suspend_begin", "suspend_end", &allocs) &&
+              checkLimit("suspend", &allocs);
+    // Resume, the background process of suspend --pid is examined as well
+    ok = measureResume(&h, cli, allocHooks, "resume", &idleResume) && ok;
+    for (size_t i = 0; i < EXTRA_PROCESSES / 2; i++) {
+        snprintf(socketPath, sizeof(socketPath), "%s/zygote-%zu", h.runtimeDir, i);
+        char *zygoteArgv[] = {(char *)cli, "zygote", "--socket", socketPath, NULL};
+        extraPids[extraPidsLen++] = harnessSpawn(zygoteArgv);
+        extraPids[extraPidsLen++] = harnessSpawn(targetArgv);
+    }
+    usleep(200000);
+    ok = measureResume(&h, cli, allocHooks, "resume (busy /proc)", &busyResume) && ok;
+    if (busyResume.allocs != idleResume.allocs) {
+        fprintf(stderr, "resume allocates per process: %lu with %d more processes, %lu "
+                "without\n", busyResume.allocs, EXTRA_PROCESSES, idleResume.allocs);
+        ok = false;
+    }
+    exitStatus = ok ? EXIT_SUCCESS : EXIT_FAILURE;
+stop:
+    for (size_t i = 0; i < extraPidsLen; i++) {
+        kill(extraPids[i], SIGKILL);
+        waitpid(extraPids[i], NULL, 0);
+    }
+    kill(targetPid, SIGKILL);
+    waitpid(targetPid, NULL, 0);
+    harnessStop(&h);
+    while (waitpid(-1, NULL, WNOHANG) > 0) {}
+    return exitStatus;
+}
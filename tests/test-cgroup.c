@@ -0,0 +1,450 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Scope of the inhibiting processes against a local cgroup2 hierarchy
+//
+// test-cgroup XDG_SCREENSAVER MOCK_SCREENSAVER
+//
+// Creates a test cgroup with "user@UID.service/app.scope" (in the subtree of
+// the user's service manager, which mock-screensaver mocks with
+// MOCK_SYSTEMD_CGROUP) and "session.scope" (outside of it) and checks that:
+// - processes of suspend started in app.scope join the scope, which is
+//   recorded, and aren't registered as unscoped
+// - processes started in session.scope are registered as unscoped until they
+//   exit
+// - resume checks the members of the scope and the unscoped processes, each
+//   once, without scanning /proc, and scans /proc without the record
+// - with Xvfb, resume releases the inhibitions of both, also while suspend
+//   still waits for the reply of Inhibit (the mock replies after a delay)
+// Skipped if no cgroup2 hierarchy is writable (needs root or delegation).
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "harness.h"
+
+#define cleanReturn(value) do { returnValue = value; goto cleanReturn; } while (false)
+
+// Reply latency of the mock, the window in which suspend is still inside
+// Inhibit
+#define MOCK_DELAY_US 200000
+
+#define SCOPE_UNIT "xdg-screensaver-shim.scope"
+
+// Counters of "resume --stats"
+struct resumeStats_t {
+    long procEntries, cgroupMembers, unscoped, pidsExamined, suspendMatches, signalled;
+};
+
+struct testCgroups_t {
+    char original[PATH_MAX];
+    char base[PATH_MAX];
+    char userService[PATH_MAX];
+    char app[PATH_MAX];
+    char session[PATH_MAX];
+    char scope[PATH_MAX];
+};
+
+bool writeFile(const char *path, const char *content) {
+    int fd;
+    if ((fd = open(path, O_WRONLY | O_CLOEXEC)) < 0) {
+        return false;
+    }
+    ssize_t contentLen = (ssize_t)strlen(content);
+    bool returnValue = write(fd, content, (size_t)contentLen) == contentLen;
+    close(fd);
+    return returnValue;
+}
+
+// Move the calling process into the cgroup at path
+bool enterCgroup(const char *path) {
+    char procsPath[PATH_MAX + 16];
+    snprintf(procsPath, sizeof(procsPath), "%s/cgroup.procs", path);
+    if (!writeFile(procsPath, "0")) {
+        fprintf(stderr, "Failed to enter %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool cgroupHasPid(const char *path, pid_t pid) {
+    char procsPath[PATH_MAX + 16];
+    int member;
+    bool found = false;
+    snprintf(procsPath, sizeof(procsPath), "%s/cgroup.procs", path);
+    FILE *procsFile;
+    if ((procsFile = fopen(procsPath, "re")) == NULL) {
+        return false;
+    }
+    while (!found && fscanf(procsFile, "%d", &member) == 1) {
+        found = member == pid;
+    }
+    fclose(procsFile);
+    return found;
+}
+
+// Create the test cgroups in the cgroup of this process (false if cgroup2 is
+// not writable)
+bool createCgroups(struct testCgroups_t *c) {
+    char line[PATH_MAX];
+    bool found = false;
+    FILE *cgroupFile;
+    if ((cgroupFile = fopen("/proc/self/cgroup", "re")) == NULL) {
+        return false;
+    }
+    while (!found && fgets(line, sizeof(line), cgroupFile) != NULL) {
+        found = strncmp(line, "0::/", 4) == 0;
+    }
+    fclose(cgroupFile);
+    if (!found) {
+        return false;
+    }
+    line[strcspn(line, "\n")] = '\0';
+    // Same lookup of the mount point as libxdgss
+    const char *mountPoint = access("/sys/fs/cgroup/cgroup.controllers", F_OK) == 0 ?
+                             "/sys/fs/cgroup" : "/sys/fs/cgroup/unified";
+    // The longest path is checked
+    if (snprintf(c->original, sizeof(c->original), "%s%s", mountPoint,
+                 strcmp(&line[3], "/") == 0 ? "" : &line[3]) < 0 ||
+            snprintf(c->base, sizeof(c->base), "%s/xdgss-test-%d", c->original, getpid()) < 0 ||
+            snprintf(c->userService, sizeof(c->userService), "%s/user@%u.service", c->base,
+                     (unsigned int)getuid()) < 0 ||
+            snprintf(c->app, sizeof(c->app), "%s/app.scope", c->userService) < 0 ||
+            snprintf(c->session, sizeof(c->session), "%s/session.scope", c->base) < 0 ||
+            snprintf(c->scope, sizeof(c->scope), "%s/" SCOPE_UNIT, c->userService) >=
+            (int)sizeof(c->scope)) {
+        return false;
+    }
+    const char *paths[] = {c->base, c->userService, c->app, c->session};
+    for (size_t i = 0; i < sizeof(paths)/sizeof(paths[0]); i++) {
+        if (mkdir(paths[i], 0755) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void removeCgroups(struct testCgroups_t *c) {
+    enterCgroup(c->original);
+    const char *paths[] = {c->scope, c->app, c->session, c->userService, c->base};
+    for (size_t i = 0; i < sizeof(paths)/sizeof(paths[0]); i++) {
+        // Exiting processes leave their cgroup with a delay
+        for (int j = 0; j < 100 && rmdir(paths[i]) < 0 && errno == EBUSY; j++) {
+            usleep(10000);
+        }
+    }
+}
+
+// Run "resume --stats window" and parse its counters
+bool runResumeStats(const char *cli, const char *window, struct resumeStats_t *returnStats) {
+    char command[PATH_MAX + 64], line[128];
+    *returnStats = (struct resumeStats_t){-1, -1, -1, -1, -1, -1};
+    snprintf(command, sizeof(command), "'%s' resume --stats %s", cli, window);
+    FILE *output;
+    if ((output = popen(command, "r")) == NULL) {
+        fprintf(stderr, "Failed to run resume: %s\n", strerror(errno));
+        return false;
+    }
+    struct {const char *name; long *value;} counters[] = {
+        {"proc_entries ", &returnStats->procEntries},
+        {"cgroup_members ", &returnStats->cgroupMembers},
+        {"unscoped ", &returnStats->unscoped},
+        {"pids_examined ", &returnStats->pidsExamined},
+        {"suspend_matches ", &returnStats->suspendMatches},
+        {"signalled ", &returnStats->signalled}};
+    while (fgets(line, sizeof(line), output) != NULL) {
+        for (size_t i = 0; i < sizeof(counters)/sizeof(counters[0]); i++) {
+            size_t nameLen = strlen(counters[i].name);
+            if (strncmp(line, counters[i].name, nameLen) == 0) {
+                *counters[i].value = strtol(&line[nameLen], NULL, 10);
+            }
+        }
+    }
+    return pclose(output) == 0;
+}
+
+bool checkStats(const char *name, const struct resumeStats_t *stats, bool procScanned,
+                long cgroupMembers, long unscoped) {
+    printf("%-28s proc_entries=%ld cgroup_members=%ld unscoped=%ld pids_examined=%ld "
+           "suspend_matches=%ld\n", name, stats->procEntries, stats->cgroupMembers,
+           stats->unscoped, stats->pidsExamined, stats->suspendMatches);
+    // Every process is examined once
+    long pidsExamined = cgroupMembers + unscoped;
+    if (procScanned ? stats->procEntries <= 0
+                    : stats->procEntries != 0 || stats->cgroupMembers != cgroupMembers ||
+                      stats->unscoped != unscoped || stats->pidsExamined != pidsExamined) {
+        fprintf(stderr, "%s: unexpected counters of resume\n", name);
+        return false;
+    }
+    return true;
+}
+
+// Path of the registration of pid as unscoped
+void unscopedPath(const struct harness_t *h, pid_t pid, char returnPath[PATH_MAX]) {
+    snprintf(returnPath, PATH_MAX, "%s/xdg-screensaver-shim/unscoped/%d", h->runtimeDir, pid);
+}
+
+// Suspend for a new process, returns the background process (-1 on failure)
+pid_t suspendForProcess(struct harness_t *h, const char *cli, pid_t *returnTargetPid) {
+    char *targetArgv[] = {"sleep", "100000", NULL}, target[32];
+    struct harnessEvent_t event;
+    pid_t knownPids[64], pids[64];
+    size_t knownPidsLen = harnessInhibitorPids(h, knownPids, 64);
+    if ((*returnTargetPid = harnessSpawn(targetArgv)) < 0) {
+        return -1;
+    }
+    snprintf(target, sizeof(target), "%d", *returnTargetPid);
+    char *suspendArgv[] = {(char *)cli, "suspend", "--pid", target, NULL};
+    if (harnessRun(suspendArgv) != 0 || !harnessWaitEvent(h, "inhibit", 5000, &event)) {
+        fprintf(stderr, "suspend --pid failed\n");
+        return -1;
+    }
+    // The background process registers its status socket after Inhibit
+    for (int i = 0; i < 500; i++) {
+        size_t pidsLen = harnessInhibitorPids(h, pids, 64);
+        for (size_t j = 0; j < pidsLen; j++) {
+            bool known = false;
+            for (size_t k = 0; !known && k < knownPidsLen; k++) {
+                known = knownPids[k] == pids[j];
+            }
+            if (!known) {
+                return pids[j];
+            }
+        }
+        usleep(10000);
+    }
+    fprintf(stderr, "No background process of suspend --pid\n");
+    return -1;
+}
+
+// Processes of suspend --pid, from app.scope (joined) and session.scope
+// (unscoped)
+bool testPid(struct harness_t *h, const char *cli, const struct testCgroups_t *c) {
+    bool returnValue = true;
+    pid_t targetPids[3] = {-1, -1, -1}, pids[3];
+    char path[PATH_MAX], record[PATH_MAX];
+    struct resumeStats_t stats;
+    struct harnessEvent_t event;
+    // The first starts the scope, the second is attached to it
+    if (!enterCgroup(c->app)) {
+        cleanReturn(false);
+    }
+    for (int i = 0; i < 2; i++) {
+        if ((pids[i] = suspendForProcess(h, cli, &targetPids[i])) < 0) {
+            cleanReturn(false);
+        }
+        unscopedPath(h, pids[i], path);
+        if (!cgroupHasPid(c->scope, pids[i]) || access(path, F_OK) == 0) {
+            fprintf(stderr, "Process %d of suspend in app.scope didn't join the scope\n",
+                    pids[i]);
+            cleanReturn(false);
+        }
+    }
+    snprintf(path, sizeof(path), "%s/xdg-screensaver-shim/scope", h->runtimeDir);
+    int fd;
+    ssize_t recordLen = -1;
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) >= 0) {
+        recordLen = read(fd, record, sizeof(record) - 1);
+        close(fd);
+    }
+    if (recordLen <= 0 || (record[recordLen] = '\0', strcmp(record, c->scope) != 0)) {
+        fprintf(stderr, "The scope is not recorded in %s\n", path);
+        cleanReturn(false);
+    }
+    if (!enterCgroup(c->session)) {
+        cleanReturn(false);
+    }
+    if ((pids[2] = suspendForProcess(h, cli, &targetPids[2])) < 0) {
+        cleanReturn(false);
+    }
+    unscopedPath(h, pids[2], path);
+    if (cgroupHasPid(c->scope, pids[2]) || access(path, F_OK) != 0) {
+        fprintf(stderr, "Process %d of suspend in session.scope is not registered as "
+                "unscoped\n", pids[2]);
+        cleanReturn(false);
+    }
+    // Processes of suspend --pid match but aren't signalled
+    if (!runResumeStats(cli, "0x1", &stats) ||
+            !checkStats("scope and unscoped", &stats, false, 2, 1) ||
+            stats.suspendMatches != 3 || stats.signalled != 0) {
+        cleanReturn(false);
+    }
+    // The registration is removed on exit
+    kill(targetPids[2], SIGKILL);
+    if (!harnessWaitEvent(h, "uninhibit", 5000, &event)) {
+        fprintf(stderr, "No UnInhibit call\n");
+        cleanReturn(false);
+    }
+    // Reparented to this process
+    waitpid(pids[2], NULL, 0);
+    if (access(path, F_OK) == 0) {
+        fprintf(stderr, "Registration %s left after exit\n", path);
+        cleanReturn(false);
+    }
+    // Registrations of killed processes are removed by resume
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0600)) >= 0) {
+        close(fd);
+    }
+    if (!runResumeStats(cli, "0x1", &stats) ||
+            !checkStats("stale registration", &stats, false, 2, 0) ||
+            access(path, F_OK) == 0) {
+        cleanReturn(false);
+    }
+    for (int i = 0; i < 2; i++) {
+        kill(targetPids[i], SIGKILL);
+        if (!harnessWaitEvent(h, "uninhibit", 5000, &event)) {
+            fprintf(stderr, "No UnInhibit call\n");
+            cleanReturn(false);
+        }
+    }
+    waitpid(pids[0], NULL, 0);
+    waitpid(pids[1], NULL, 0);
+    if (!runResumeStats(cli, "0x1", &stats) ||
+            !checkStats("empty scope", &stats, false, 0, 0)) {
+        cleanReturn(false);
+    }
+    // Nothing is known without the record
+    snprintf(path, sizeof(path), "%s/xdg-screensaver-shim/scope", h->runtimeDir);
+    unlink(path);
+    if (!runResumeStats(cli, "0x1", &stats) ||
+            !checkStats("without record", &stats, true, 0, 0)) {
+        cleanReturn(false);
+    }
+cleanReturn:
+    for (int i = 0; i < 3; i++) {
+        if (targetPids[i] > 0) {
+            kill(targetPids[i], SIGKILL);
+            waitpid(targetPids[i], NULL, 0);
+        }
+    }
+    harnessSettle(h, 200);
+    return returnValue;
+}
+
+#ifdef HAVE_X11
+// resume releases windows of processes in the scope and unscoped ones, also
+// while suspend still waits for the reply of Inhibit
+bool testWindows(struct harness_t *h, const char *cli, const struct testCgroups_t *c) {
+    bool returnValue = true;
+    const char *cgroups[] = {c->app, c->session};
+    unsigned long window = 0;
+    pid_t suspendPid = -1;
+    char windowArg[32];
+    struct resumeStats_t stats;
+    struct harnessEvent_t event;
+    for (size_t i = 0; i < sizeof(cgroups)/sizeof(cgroups[0]); i++) {
+        const char *name = i == 0 ? "scope" : "unscoped";
+        if (!enterCgroup(cgroups[i]) || (window = harnessCreateWindow(h)) == 0) {
+            cleanReturn(false);
+        }
+        harnessWindowArg(window, windowArg);
+        char *suspendArgv[] = {(char *)cli, "suspend", windowArg, NULL};
+        if (harnessRun(suspendArgv) != 0 || !harnessWaitEvent(h, "inhibit", 5000, &event)) {
+            fprintf(stderr, "%s: suspend failed\n", name);
+            cleanReturn(false);
+        }
+        if (!runResumeStats(cli, windowArg, &stats) || stats.procEntries != 0 ||
+                stats.signalled < 1 || !harnessWaitEvent(h, "uninhibit", 5000, &event)) {
+            fprintf(stderr, "%s: resume didn't release the window\n", name);
+            cleanReturn(false);
+        }
+        // Signalled while it waits for the reply of Inhibit
+        if ((suspendPid = harnessSpawn(suspendArgv)) < 0) {
+            cleanReturn(false);
+        }
+        char path[PATH_MAX];
+        unscopedPath(h, suspendPid, path);
+        for (int j = 0; j < 500 && !(i == 0 ? cgroupHasPid(c->scope, suspendPid)
+                                            : access(path, F_OK) == 0); j++) {
+            usleep(1000);
+        }
+        if (!runResumeStats(cli, windowArg, &stats) || stats.procEntries != 0 ||
+                stats.signalled < 1) {
+            fprintf(stderr, "%s: resume didn't find suspend inside Inhibit\n", name);
+            cleanReturn(false);
+        }
+        waitpid(suspendPid, NULL, 0);
+        suspendPid = -1;
+        if (!harnessWaitEvent(h, "inhibit", 5000, &event) ||
+                !harnessWaitEvent(h, "uninhibit", 5000, &event)) {
+            fprintf(stderr, "%s: inhibition of suspend inside Inhibit leaked\n", name);
+            cleanReturn(false);
+        }
+        printf("%-28s released, also inside Inhibit\n", name);
+        harnessDestroyWindow(h, window);
+        window = 0;
+    }
+cleanReturn:
+    if (suspendPid > 0) {
+        waitpid(suspendPid, NULL, 0);
+    }
+    if (window != 0) {
+        harnessDestroyWindow(h, window);
+    }
+    harnessSettle(h, 200);
+    return returnValue;
+}
+#endif
+
+int main(int argc, char *argv[]) {
+    struct harness_t h;
+    struct testCgroups_t c = {0};
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s XDG_SCREENSAVER MOCK_SCREENSAVER\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *cli = argv[1];
+    if (!createCgroups(&c)) {
+        printf("No writable cgroup2 hierarchy\n");
+        if (c.base[0] != '\0') {
+            removeCgroups(&c);
+        }
+        return HARNESS_SKIP;
+    }
+    // Background processes are reparented to this process
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+    setenv("MOCK_SYSTEMD_CGROUP", c.userService, true);
+    bool ok = harnessStart(&h, argv[2], MOCK_DELAY_US, true);
+    ok = ok && testPid(&h, cli, &c);
+    if (ok && harnessHasX(&h)) {
+#ifdef HAVE_X11
+        ok = testWindows(&h, cli, &c);
+#endif
+    } else if (ok) {
+        printf("Xvfb not found, skipping windows\n");
+    }
+    if (ok && (harnessActive(&h) > 0 || h.doubleUninhibits > 0)) {
+        fprintf(stderr, "%lu inhibitions left active, %lu released twice\n",
+                harnessActive(&h), h.doubleUninhibits);
+        ok = false;
+    }
+    enterCgroup(c.original);
+    harnessStop(&h);
+    while (waitpid(-1, NULL, WNOHANG) > 0) {}
+    removeCgroups(&c);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Heap allocations of the background process of "xdg-screensaver suspend
+// --pid" from receiving SIGTERM to exiting, must be zero with --fast-teardown
+//
+// test-teardown-alloc XDG_SCREENSAVER MOCK_SCREENSAVER ALLOC_HOOKS
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <limits.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include "harness.h"
+
+#define cleanReturn(value) do { returnValue = value; goto cleanReturn; } while (false)
+
+// Allocations from SIGTERM to exit of the background process
+bool measureTeardown(struct harness_t *h, const char *cli, const char *allocHooks,
+                     bool fastTeardown, struct harnessAllocs_t *returnAllocs) {
+    bool returnValue = true;
+    char tracePath[PATH_MAX], reportPath[PATH_MAX], targetArg[16];
+    struct harnessEvent_t event;
+    pid_t backgroundPid = 0;
+    char *targetArgv[] = {"sleep", "1000", NULL};
+    pid_t targetPid = harnessSpawn(targetArgv);
+    if (targetPid < 0) {
+        return false;
+    }
+    snprintf(targetArg, sizeof(targetArg), "%d", targetPid);
+    snprintf(tracePath, sizeof(tracePath), "%s/trace-%d", h->runtimeDir, fastTeardown);
+    snprintf(reportPath, sizeof(reportPath), "%s/allocs-%d", h->runtimeDir, fastTeardown);
+    char *suspendArgv[] = {(char *)cli, "suspend", "--pid", targetArg, NULL};
+    char *fastSuspendArgv[] = {(char *)cli, "suspend", "--fast-teardown", "--pid", targetArg,
+                               NULL};
+    setenv("XDGSS_TRACE", tracePath, true);
+    setenv("ALLOC_HOOKS_REPORT", reportPath, true);
+    setenv("LD_PRELOAD", allocHooks, true);
+    int status = harnessRun(fastTeardown ? fastSuspendArgv : suspendArgv);
+    unsetenv("LD_PRELOAD");
+    unsetenv("ALLOC_HOOKS_REPORT");
+    unsetenv("XDGSS_TRACE");
+    if (status != 0 || !harnessWaitEvent(h, "inhibit", 5000, &event)) {
+        fprintf(stderr, "suspend failed\n");
+        cleanReturn(false);
+    }
+    // The status socket is created after the fork
+    for (int i = 0; i < 500 && harnessInhibitorPids(h, &backgroundPid, 1) == 0; i++) {
+        usleep(10000);
+    }
+    if (backgroundPid <= 0) {
+        fprintf(stderr, "Background process not found\n");
+        cleanReturn(false);
+    }
+    kill(backgroundPid, SIGTERM);
+    // Reaped here because this process is the subreaper
+    waitpid(backgroundPid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+            !harnessWaitEvent(h, "uninhibit", 5000, &event)) {
+        fprintf(stderr, "Background process failed\n");
+        cleanReturn(false);
+    }
+    if (!harnessAllocDelta(reportPath, backgroundPid, "signal", "exit", returnAllocs)) {
+        cleanReturn(false);
+    }
+    printf("%-16s allocations=%lu bytes=%lu peak=%ld\n",
+           fastTeardown ? "fast teardown" : "default teardown", returnAllocs->allocs,
+           returnAllocs->bytes, returnAllocs->peak);
+cleanReturn:
+    kill(targetPid, SIGKILL);
+    waitpid(targetPid, NULL, 0);
+    return returnValue;
+}
+
+int main(int argc, char *argv[]) {
+    struct harness_t h;
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s XDG_SCREENSAVER MOCK_SCREENSAVER ALLOC_HOOKS\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    // Background processes are reparented to this process
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+    if (!harnessStart(&h, argv[2], 0, false)) {
+        harnessStop(&h);
+        return EXIT_FAILURE;
+    }
+    int exitStatus = EXIT_FAILURE;
+    struct harnessAllocs_t defaultAllocs, fastAllocs;
+    if (!measureTeardown(&h, argv[1], argv[3], false, &defaultAllocs) ||
+            !measureTeardown(&h, argv[1], argv[3], true, &fastAllocs)) {
+        goto stop;
+    }
+    if (fastAllocs.allocs != 0) {
+        fprintf(stderr, "Fast teardown allocated %lu times\n", fastAllocs.allocs);
+        goto stop;
+    }
+    exitStatus = EXIT_SUCCESS;
+stop:
+    harnessStop(&h);
+    return exitStatus;
+}
@@ -15,470 +15,1452 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
 #include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
-#include <dirent.h>
-#include <ctype.h>
-#include <fcntl.h>
 #include <signal.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <dirent.h>
 #include <sys/signalfd.h>
-#include <dbus/dbus.h>
-#include <X11/Xlib.h>
-#include <X11/Xlibint.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <dlfcn.h>
 #include "project-config.h"
+#include "xdgss.h"
+#include "xdgss-scan.h"
+#include "xdgss-trace.h"
 
 const int EXIT_SIGNALS[] = {SIGHUP, SIGINT, SIGPIPE, SIGQUIT, SIGTERM, 0};
-const size_t NULL_BYTE_LEN = 1;
 
 #define cleanReturn(value) do { returnValue = value; goto cleanReturn; } while (false)
 
-bool allocSprintf(char **returnStr, const char *format, ...) {
-    va_list ap;
-    bool returnValue = true;
-    char *str = NULL;
-    va_start(ap, format);
-    int strLen = vsnprintf(NULL, 0, format, ap);
-    va_end(ap);
-    if (strLen < 0) {
-        fprintf(stderr, "Unexpected vsnprintf error encountered\n");
-        cleanReturn(false);
+// libxdgss (with libdbus and libX11) is only loaded by operations that inhibit
+struct xdgssLib_t {
+    void *dl;
+    xdgss_handle *(*suspend)(unsigned long);
+    xdgss_handle *(*suspend_windows)(const unsigned long *, size_t, unsigned int);
+    xdgss_handle *(*suspend_pid_flags)(int, unsigned int);
+    bool (*release_window)(xdgss_handle *, unsigned long);
+    bool (*resume)(xdgss_handle *);
+    bool (*is_active)(const xdgss_handle *);
+    void (*get_info)(const xdgss_handle *, xdgss_info *);
+    void (*get_stats)(xdgss_stats *);
+    int (*get_fd)(void);
+    bool (*dispatch)(void);
+    void (*shutdown)(void);
+    bool (*join_scope)(void);
+} xdgssLib;
+
+bool loadXdgssLib() {
+    struct xdgssLib_t *l = &xdgssLib;
+    if (l->dl != NULL) {
+        return true;
     }
-    size_t size = (size_t)strLen + NULL_BYTE_LEN;
-    if ((str = malloc(size)) == NULL) {
-        fprintf(stderr, "Out of memory\n");
-        cleanReturn(false);
+    if ((l->dl = dlopen(XDGSS_LIB_SONAME, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+        fprintf(stderr, "Failed to load %s: %s\n", XDGSS_LIB_SONAME, dlerror());
+        return false;
     }
-    va_start(ap, format);
-    int strLen2 = vsnprintf(str, size, format, ap);
-    va_end(ap);
-    if (strLen != strLen2) {
-        fprintf(stderr, "Unexpected vsnprintf error encountered\n");
-        cleanReturn(false);
+    struct {void **func; const char *name;} syms[] = {
+        {(void **)&l->suspend, "xdgss_suspend"},
+        {(void **)&l->suspend_windows, "xdgss_suspend_windows"},
+        {(void **)&l->suspend_pid_flags, "xdgss_suspend_pid_flags"},
+        {(void **)&l->release_window, "xdgss_release_window"},
+        {(void **)&l->resume, "xdgss_resume"},
+        {(void **)&l->is_active, "xdgss_is_active"},
+        {(void **)&l->get_info, "xdgss_get_info"},
+        {(void **)&l->get_stats, "xdgss_get_stats"},
+        {(void **)&l->get_fd, "xdgss_get_fd"},
+        {(void **)&l->dispatch, "xdgss_dispatch"},
+        {(void **)&l->shutdown, "xdgss_shutdown"},
+        {(void **)&l->join_scope, "xdgss_join_scope"}};
+    for (size_t i = 0; i < sizeof(syms)/sizeof(syms[0]); i++) {
+        if ((*syms[i].func = dlsym(l->dl, syms[i].name)) == NULL) {
+            fprintf(stderr, "Failed to load %s: %s\n", syms[i].name, dlerror());
+            dlclose(l->dl);
+            l->dl = NULL;
+            return false;
+        }
     }
-cleanReturn:
-    if (!returnValue) {
-        free(str);
-        str = NULL;
+    return true;
+}
+
+// Block EXIT_SIGNALS and receive them on a signal fd instead
+bool createSignalFd(int extraSignal, int *returnFd) {
+    sigset_t exit_sigset;
+    sigemptyset(&exit_sigset);
+    for (int i = 0; EXIT_SIGNALS[i] != 0; i++) {
+        sigaddset(&exit_sigset, EXIT_SIGNALS[i]);
     }
-    *returnStr = str;
-    return returnValue;
+    if (extraSignal != 0) {
+        sigaddset(&exit_sigset, extraSignal);
+    }
+    if (sigprocmask(SIG_BLOCK, &exit_sigset, NULL) < 0) {
+        fprintf(stderr, "Failed to block signals: %s\n", strerror(errno));
+        return false;
+    }
+    if ((*returnFd = signalfd(-1, &exit_sigset, SFD_CLOEXEC)) < 0) {
+        fprintf(stderr, "Failed to create signal fd: %s\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// Read signal from signal fd (exit signals are logged)
+// (returnSigPtr receives the value sent with sigqueue and may be NULL)
+bool readSignalFd(int signalFd, int *returnSigno, uint64_t *returnSigPtr) {
+    struct signalfd_siginfo siginfo;
+    if (read(signalFd, &siginfo, sizeof(struct signalfd_siginfo)) < 0) {
+        fprintf(stderr, "Failed to read signal fd: %s\n", strerror(errno));
+        return false;
+    }
+    if (siginfo.ssi_signo != SIGCHLD && (int)siginfo.ssi_signo != XDGSS_RELEASE_WINDOW_SIGNAL) {
+        fprintf(stderr, "Received signal %d (%s)\n", siginfo.ssi_signo,
+                strsignal((int)siginfo.ssi_signo));
+    }
+    *returnSigno = (int)siginfo.ssi_signo;
+    if (returnSigPtr != NULL) {
+        *returnSigPtr = siginfo.ssi_ptr;
+    }
+    return true;
+}
+
+bool parseWindow(const char *str, unsigned long *returnWindow) {
+    char *windowEnd;
+    *returnWindow = strtoul(str, &windowEnd, 0);
+    if (str[0] == '\0' || windowEnd[0] != '\0') {
+        fprintf(stderr, "Invalid WindowId: %s\n", str);
+        return false;
+    }
+    return true;
+}
+
+bool listenUnixSocket(const char *path, int *returnFd) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+    int fd;
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        fprintf(stderr, "Failed to create socket: %s\n", strerror(errno));
+        return false;
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        fprintf(stderr, "Failed to listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    *returnFd = fd;
+    return true;
 }
 
 struct operationSuspendData_t {
-    DBusError dbusErr;
-    DBusConnection *dbusConn;
-    char *inhibitReason;
-    DBusMessage *inhibitMsg, *inhibitReplyMsg, *unInhibitMsg, *unInhibitReplyMsg;
-    dbus_uint32_t screenSaverInhibitCookie;
-    bool screenSaverInhibited;
-    Display *display;
+    xdgss_handle *handle;
     int signalFd;
+    int pidFd;
+    // Windows that the inhibition is bound to
+    const unsigned long *windows;
+    size_t windowsLen;
+    unsigned int flags;
+    // Process that the inhibition is bound to instead of window (0 if none)
+    pid_t pid;
+    // Window whose release by XDGSS_RELEASE_WINDOW_SIGNAL ended the inhibition
+    // (0 if it didn't)
+    unsigned long signalReleasedWindow;
+    // Number of times the process woke up while waiting
+    unsigned long wakeups;
+    // Why the inhibition ends (for tracing)
+    const char *finishReason;
+    // Socket that answers status queries (-1 if none)
+    int statusFd;
+    char *statusPath;
+    time_t startTime;
+    struct timespec startMonotonic;
+    // Registration as unscoped if the process couldn't join the scope (NULL
+    // if it joined), removed without allocating on exit
+    char *unscopedPath;
 } operationSuspendData;
 
-bool operationSuspendFinish() {
-    bool returnValue = true;
+// Join the scope of the inhibiting processes, in which resume finds this
+// process and its children without scanning /proc, or register as unscoped
+// (returnUnscopedPath is the registration, NULL if the process joined). Fails
+// if resume could miss the process: it neither joined nor registered, but
+// resume skips /proc if the scope was recorded.
+bool joinInhibitorScope(char **returnUnscopedPath) {
+    char *unscopedPath = NULL;
+    // Registered first, resume must find the process while it joins
+    bool unscoped = markUnscoped(getpid(), true);
+    bool joined = xdgssLib.join_scope() && recordScanCgroup();
+    xdgssTrace("join_scope", "\"ok\":%s", TRACE_BOOL(joined));
+    if (joined) {
+        markUnscoped(getpid(), false);
+    } else if (unscoped) {
+        allocUnscopedPath(getpid(), &unscopedPath);
+    } else if (!allocUnscopedPath(getpid(), &unscopedPath) || unscopedPath != NULL) {
+        // Only without XDG_RUNTIME_DIR there's no record and resume scans /proc
+        fprintf(stderr, "Failed to register for resume\n");
+        free(unscopedPath);
+        *returnUnscopedPath = NULL;
+        return false;
+    }
+    *returnUnscopedPath = unscopedPath;
+    return true;
+}
+
+// Remove the registration as unscoped (if any)
+void removeUnscoped(char **unscopedPath) {
+    if (*unscopedPath != NULL) {
+        unlink(*unscopedPath);
+        free(*unscopedPath);
+        *unscopedPath = NULL;
+    }
+}
+
+// Directory with the status sockets of all inhibiting processes
+bool allocStatusDirPath(char **returnPath) {
+    const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
+    if (runtimeDir == NULL || runtimeDir[0] == '\0') {
+        *returnPath = NULL;
+        return true;
+    }
+    return allocSprintf(returnPath, "%s/xdg-screensaver-shim/inhibitors", runtimeDir);
+}
+
+// Start answering status queries on STATUS_DIR/PID (failures are not fatal)
+void openStatusSocket() {
     struct operationSuspendData_t *d = &operationSuspendData;
-    if (d->inhibitReplyMsg != NULL) {
-        dbus_message_unref(d->inhibitReplyMsg);
+    char *dirPath = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &d->startMonotonic);
+    d->startTime = time(NULL);
+    if (!allocStatusDirPath(&dirPath) || dirPath == NULL) {
+        return;
     }
-    if (d->inhibitMsg != NULL) {
-        dbus_message_unref(d->inhibitMsg);
+    // Create the parent directory first
+    char *dirPathSep = strrchr(dirPath, '/');
+    *dirPathSep = '\0';
+    mkdir(dirPath, 0700);
+    *dirPathSep = '/';
+    if (mkdir(dirPath, 0700) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Failed to create %s: %s\n", dirPath, strerror(errno));
+    } else if (allocSprintf(&d->statusPath, "%s/%d", dirPath, getpid())) {
+        // Left behind by a killed process with the same PID
+        unlink(d->statusPath);
+        if (!listenUnixSocket(d->statusPath, &d->statusFd)) {
+            free(d->statusPath);
+            d->statusPath = NULL;
+            d->statusFd = -1;
+        }
     }
-    free(d->inhibitReason);
-    dbus_error_free(&d->dbusErr);
-    // Un-inhibit screen saver
-    if (!d->screenSaverInhibited) {
-        goto unInhibitScreenSaverEnd;
-    }
-    if ((d->unInhibitMsg = dbus_message_new_method_call(
-            "org.freedesktop.ScreenSaver",
-            "/org/freedesktop/ScreenSaver",
-            "org.freedesktop.ScreenSaver",
-            "UnInhibit")) == NULL) {
-        fprintf(stderr, "Out of memory\n");
-        returnValue = false;
-        goto unInhibitScreenSaverEnd;
+    free(dirPath);
+}
+
+void closeStatusSocket() {
+    struct operationSuspendData_t *d = &operationSuspendData;
+    if (d->statusFd != -1) {
+        close(d->statusFd);
+        d->statusFd = -1;
     }
-    DBusMessageIter unInhibitMsgIter;
-    dbus_message_iter_init_append(d->unInhibitMsg, &unInhibitMsgIter);
-    if (!dbus_message_iter_append_basic(
-            &unInhibitMsgIter, DBUS_TYPE_UINT32, &d->screenSaverInhibitCookie)) {
-        fprintf(stderr, "Out of memory\n");
-        returnValue = false;
-        goto unInhibitScreenSaverEnd;
+    if (d->statusPath != NULL) {
+        unlink(d->statusPath);
+        free(d->statusPath);
+        d->statusPath = NULL;
     }
-    if ((d->unInhibitReplyMsg = dbus_connection_send_with_reply_and_block(
-            d->dbusConn, d->unInhibitMsg, DBUS_TIMEOUT_USE_DEFAULT, &d->dbusErr)) == NULL) {
-        if (dbus_error_is_set(&d->dbusErr)) {
-            fprintf(stderr, "Failed to call D-Bus method: %s\n", d->dbusErr.message);
+}
+
+// Answer a status query with one JSON line
+void replyStatus() {
+    struct operationSuspendData_t *d = &operationSuspendData;
+    int clientFd;
+    char *reply = NULL;
+    size_t replyLen = 0;
+    FILE *replyFile;
+    if ((clientFd = accept4(d->statusFd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK)) < 0) {
+        return;
+    }
+    if ((replyFile = open_memstream(&reply, &replyLen)) == NULL) {
+        close(clientFd);
+        return;
+    }
+    xdgss_info info;
+    xdgss_stats stats;
+    xdgssLib.get_info(d->handle, &info);
+    xdgssLib.get_stats(&stats);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long rssKb = -1, residentPages;
+    FILE *statmFile;
+    if ((statmFile = fopen("/proc/self/statm", "re")) != NULL) {
+        if (fscanf(statmFile, "%*d %ld", &residentPages) == 1) {
+            rssKb = residentPages * (sysconf(_SC_PAGESIZE) / 1024);
         }
-        returnValue = false;
-        goto unInhibitScreenSaverEnd;
+        fclose(statmFile);
     }
-    DBusMessageIter unInhibitReplyMsgIter;
-    dbus_message_iter_init(d->unInhibitReplyMsg, &unInhibitReplyMsgIter);
-    if (dbus_message_iter_get_arg_type(&unInhibitReplyMsgIter) != DBUS_TYPE_INVALID) {
-        fprintf(stderr, "Unexpected D-Bus reply\n");
-        returnValue = false;
-        goto unInhibitScreenSaverEnd;
+    long fds = 0;
+    DIR *fdDir;
+    if ((fdDir = opendir("/proc/self/fd")) != NULL) {
+        while (readdir(fdDir) != NULL) {
+            fds++;
+        }
+        // Without ".", ".." and the descriptor of the directory
+        fds -= 3;
+        closedir(fdDir);
+    }
+    fprintf(replyFile, "{\"pid\":%d,\"windows\":[", getpid());
+    for (size_t i = 0; i < d->windowsLen; i++) {
+        fprintf(replyFile, "%s%lu", i > 0 ? "," : "", d->windows[i]);
     }
-unInhibitScreenSaverEnd:
-    if (d->unInhibitReplyMsg != NULL) {
-        dbus_message_unref(d->unInhibitReplyMsg);
+    fprintf(replyFile, "],\"target\":%d,\"backend\":\"%s\",\"cookie\":%u,"
+            "\"start_time\":%" PRId64 ",\"age_s\":%" PRId64 ",\"wakeups\":%lu,"
+            "\"x_events\":{", d->pid, info.backend, info.cookie, (int64_t)d->startTime,
+            (int64_t)(now.tv_sec - d->startMonotonic.tv_sec), d->wakeups);
+    const char *sep = "";
+    for (int i = 0; i < XDGSS_X_EVENT_TYPES; i++) {
+        if (stats.x_events[i] > 0) {
+            fprintf(replyFile, "%s\"%d\":%lu", sep, i, stats.x_events[i]);
+            sep = ",";
+        }
     }
-    if (d->unInhibitMsg != NULL) {
-        dbus_message_unref(d->unInhibitMsg);
+    // Keys are the lower bounds of the buckets
+    fprintf(replyFile, "},\"dbus_rtt_us\":{");
+    sep = "";
+    for (int i = 0; i < XDGSS_RTT_BUCKETS; i++) {
+        if (stats.dbus_rtt[i] > 0) {
+            fprintf(replyFile, "%s\"%lu\":%lu", sep, i > 0 ? 1UL << i : 0, stats.dbus_rtt[i]);
+            sep = ",";
+        }
     }
-    dbus_error_free(&d->dbusErr);
-    if (d->dbusConn != NULL) {
-        dbus_connection_unref(d->dbusConn);
+    fprintf(replyFile, "},\"rss_kb\":%ld,\"fds\":%ld}\n", rssKb, fds);
+    if (fclose(replyFile) == 0) {
+        // Small enough for the socket buffer
+        send(clientFd, reply, replyLen, MSG_NOSIGNAL);
+    }
+    free(reply);
+    close(clientFd);
+}
+
+bool operationSuspendFinish() {
+    bool returnValue = true;
+    struct operationSuspendData_t *d = &operationSuspendData;
+    xdgssTrace("finish_begin", "\"reason\":\"%s\"",
+               d->finishReason != NULL ? d->finishReason : "error");
+    PROBE0(finish_begin);
+    // Un-inhibit screen saver
+    if (!xdgssLib.resume(d->handle)) {
+        returnValue = false;
+    }
+    xdgssLib.shutdown();
+    if (d->pidFd != -1) {
+        close(d->pidFd);
     }
     if (d->signalFd != -1) {
         close(d->signalFd);
     }
-    if (d->display != NULL) {
-        // Unset custom X error handlers because they call this function
-        XSetErrorHandler(NULL);
-        XSetIOErrorHandler(NULL);
-        XCloseDisplay(d->display);
-    }
+    closeStatusSocket();
+    removeUnscoped(&d->unscopedPath);
+    xdgssTrace("finish_end", "\"ok\":%s", TRACE_BOOL(returnValue));
+    PROBE1(finish_end, returnValue);
     return returnValue;
 }
 
-// X Error Handler that calls operationSuspendFinish before exiting
-int operationSuspendXErrorHandler(Display *display, XErrorEvent *ev) {
-    operationSuspendData.display = NULL; // don't free display structure
-    operationSuspendFinish();
-    _XDefaultError(display, ev); // may not return
-    exit(EXIT_FAILURE);
+// Release resources that the long-lived background process doesn't need
+void reduceFootprint() {
+    // Single-threaded, keep the heap compact and return freed memory early
+    mallopt(M_ARENA_MAX, 1);
+    mallopt(M_TRIM_THRESHOLD, 64 * 1024);
+    mallopt(M_MMAP_THRESHOLD, 64 * 1024);
+    // Nobody reads from or writes to the background process, errors still go
+    // to stderr (also doesn't block callers that wait for EOF on stdout)
+    int nullFd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (nullFd != -1) {
+        dup2(nullFd, STDIN_FILENO);
+        dup2(nullFd, STDOUT_FILENO);
+        if (nullFd > STDOUT_FILENO) {
+            close(nullFd);
+        }
+    }
+    malloc_trim(0);
 }
 
-// X IO Error Handler that calls operationSuspendFinish before exiting
-int operationSuspendXIOErrorHandler(Display *display) {
-    operationSuspendData.display = NULL; // don't free display structure
-    operationSuspendFinish();
-    _XDefaultIOError(display); // may not return
-    exit(EXIT_FAILURE);
+// Wait until the windows are destroyed or a signal is received and un-inhibit
+bool operationSuspendWait() {
+    bool returnValue = true;
+    struct operationSuspendData_t *d = &operationSuspendData;
+    // Descriptors can exceed FD_SETSIZE in callers with many open files
+    struct pollfd fds[] = {
+        {.fd = d->signalFd, .events = POLLIN},
+        {.fd = xdgssLib.get_fd(), .events = POLLIN},
+        {.fd = d->statusFd, .events = POLLIN}}; // ignored if -1
+    while (true) {
+        // Handle pending events (required before poll)
+        if (!xdgssLib.dispatch()) {
+            cleanReturn(false);
+        }
+        if (!xdgssLib.is_active(d->handle)) {
+            if (d->signalReleasedWindow != 0) {
+                fprintf(stderr, "Window 0x%lx released, no windows left\n",
+                        d->signalReleasedWindow);
+                d->finishReason = "signal";
+                cleanReturn(true);
+            }
+            if (d->pid != 0) {
+                fprintf(stderr, "Process %d exited\n", d->pid);
+            } else if (d->windowsLen > 1) {
+                fprintf(stderr, "All %zu windows destroyed\n", d->windowsLen);
+            } else if (d->flags & XDGSS_WATCH_OWNER) {
+                fprintf(stderr, "Window 0x%lx destroyed or its owner exited\n", d->windows[0]);
+            } else {
+                fprintf(stderr, "Window 0x%lx destroyed\n", d->windows[0]);
+            }
+            d->finishReason = d->pid != 0 ? "exited" : "destroyed";
+            cleanReturn(true);
+        }
+        if (poll(fds, sizeof(fds)/sizeof(fds[0]), -1) < 0) {
+            fprintf(stderr, "Failed to block on file descriptors: %s\n", strerror(errno));
+            cleanReturn(false);
+        }
+        d->wakeups++;
+        if (fds[2].revents & POLLIN) {
+            replyStatus();
+        }
+        if (fds[0].revents & POLLIN) {
+            int signo = 0;
+            uint64_t sigPtr = 0;
+            readSignalFd(d->signalFd, &signo, &sigPtr);
+            xdgssTrace("signal", "\"signal\":%d", signo);
+            PROBE1(signal, signo);
+            if (signo != XDGSS_RELEASE_WINDOW_SIGNAL) {
+                d->finishReason = "signal";
+                cleanReturn(signo == SIGTERM);
+            }
+            // Sent by resume for one of several windows
+            if (!xdgssLib.release_window(d->handle, (unsigned long)sigPtr)) {
+                cleanReturn(false);
+            }
+            if (!xdgssLib.is_active(d->handle)) {
+                d->signalReleasedWindow = (unsigned long)sigPtr;
+            }
+        }
+    }
+cleanReturn:
+    if (d->flags & XDGSS_WATCH_OWNER) {
+        fprintf(stderr, "Woke up %lu times\n", d->wakeups);
+    }
+    if (!operationSuspendFinish()) {
+        returnValue = false;
+    }
+    return returnValue;
 }
 
-bool operationSuspend(const char *prog, Window window) {
+// Suspend until all windows are destroyed or, if pid is not 0, until process
+// pid exits
+bool operationSuspend(const unsigned long *windows, size_t windowsLen, unsigned int flags,
+                      pid_t pid) {
     bool returnValue = true;
+    if (!loadXdgssLib()) {
+        return false;
+    }
     struct operationSuspendData_t *d = &operationSuspendData;
     *d = (struct operationSuspendData_t){0};
-    dbus_error_init(&d->dbusErr);
     d->signalFd = -1;
-    // Set up signal fd
-    sigset_t exit_sigset;
-    sigemptyset(&exit_sigset);
-    for (int i = 0; EXIT_SIGNALS[i] != 0; i++) {
-        sigaddset(&exit_sigset, EXIT_SIGNALS[i]);
+    d->pidFd = -1;
+    d->statusFd = -1;
+    d->windows = windows;
+    d->windowsLen = windowsLen;
+    d->flags = flags;
+    d->pid = pid;
+    xdgssTrace("suspend_begin", "\"mode\":\"%s\",\"windows\":%zu,\"target\":%d,\"flags\":%u",
+               pid != 0 ? "pid" : "windows", windowsLen, pid, flags);
+    // The list of windows doesn't fit in one line
+    for (size_t i = 0; i < windowsLen; i++) {
+        xdgssTrace("suspend_window", "\"window\":%lu", windows[i]);
     }
-    if (sigprocmask(SIG_BLOCK, &exit_sigset, NULL) < 0) {
-        fprintf(stderr, "Failed to block signals: %s\n", strerror(errno));
-        cleanReturn(false);
-    }
-    if ((d->signalFd = signalfd(-1, &exit_sigset, SFD_CLOEXEC)) < 0) {
-        fprintf(stderr, "Failed to create signal fd: %s\n", strerror(errno));
+    PROBE2(suspend_begin, windowsLen, pid);
+    // Set up signal fd
+    if (!createSignalFd(windowsLen > 1 ? XDGSS_RELEASE_WINDOW_SIGNAL : 0, &d->signalFd)) {
         cleanReturn(false);
     }
-    // Init D-Bus
-    if ((d->dbusConn = dbus_bus_get(DBUS_BUS_SESSION, &d->dbusErr)) == NULL) {
-        if (dbus_error_is_set(&d->dbusErr)) {
-            fprintf(stderr, "Failed to connect D-Bus: %s\n", d->dbusErr.message);
-        }
+    // Before inhibiting, resume must be able to signal this process from now
+    // on (the background process inherits the cgroup)
+    if (!joinInhibitorScope(&d->unscopedPath)) {
         cleanReturn(false);
     }
     // Inhibit screen saver
-    if ((d->inhibitMsg = dbus_message_new_method_call(
-            "org.freedesktop.ScreenSaver",
-            "/org/freedesktop/ScreenSaver",
-            "org.freedesktop.ScreenSaver",
-            "Inhibit")) == NULL) {
-        fprintf(stderr, "Out of memory\n");
+    if ((d->handle = pid != 0 ? xdgssLib.suspend_pid_flags(pid, flags)
+                              : xdgssLib.suspend_windows(windows, windowsLen, flags)) == NULL) {
         cleanReturn(false);
     }
-    DBusMessageIter inhibitMsgIter;
-    dbus_message_iter_init_append(d->inhibitMsg, &inhibitMsgIter);
-    if (!dbus_message_iter_append_basic(
-            &inhibitMsgIter, DBUS_TYPE_STRING, &prog)) {
-        fprintf(stderr, "Out of memory\n");
+    // Fork into background
+    xdgssTrace("fork", NULL);
+    pid_t parentPid = getpid(), childPid;
+    if ((childPid = fork()) < 0) {
+        fprintf(stderr, "Failed to fork: %s\n", strerror(errno));
         cleanReturn(false);
     }
-    if (!allocSprintf(&d->inhibitReason, "waiting for X window %#lx", window)) {
-        cleanReturn(false);
+    if (childPid != 0) {
+        // Pending signals are not inherited, forward those that arrived before
+        // the fork (e.g. from resume) instead of leaking the inhibition
+        struct pollfd fd = {.fd = d->signalFd, .events = POLLIN};
+        struct signalfd_siginfo siginfo;
+        while (poll(&fd, 1, 0) > 0 &&
+               read(d->signalFd, &siginfo, sizeof(siginfo)) == sizeof(siginfo)) {
+            sigqueue(childPid, (int)siginfo.ssi_signo,
+                     (union sigval){.sival_ptr = (void *)(uintptr_t)siginfo.ssi_ptr});
+        }
+        // Hand the registration over before exiting, so that it's never
+        // missing while the child inhibits
+        if (d->unscopedPath != NULL) {
+            markUnscoped(childPid, true);
+            unlink(d->unscopedPath);
+        }
+        // Terminate immediately without cleanup
+        exit(EXIT_SUCCESS);
     }
-    if (!dbus_message_iter_append_basic(
-            &inhibitMsgIter, DBUS_TYPE_STRING, &d->inhibitReason)) {
-        fprintf(stderr, "Out of memory\n");
-        cleanReturn(false);
+    xdgssTrace("suspend_end", "\"parent\":%d", parentPid);
+    PROBE0(suspend_end);
+    // Registered by the parent
+    if (d->unscopedPath != NULL) {
+        free(d->unscopedPath);
+        allocUnscopedPath(getpid(), &d->unscopedPath);
     }
-    if ((d->inhibitReplyMsg = dbus_connection_send_with_reply_and_block(
-            d->dbusConn, d->inhibitMsg, DBUS_TIMEOUT_USE_DEFAULT, &d->dbusErr)) == NULL) {
-        if (dbus_error_is_set(&d->dbusErr)) {
-            fprintf(stderr, "Failed to call D-Bus method: %s\n", d->dbusErr.message);
-        }
-        cleanReturn(false);
+    openStatusSocket();
+    reduceFootprint();
+    return operationSuspendWait();
+cleanReturn:
+    if (!operationSuspendFinish()) {
+        returnValue = false;
+    }
+    return returnValue;
+}
+
+// Hold the inhibition while the command runs and exit with its status
+// (the command runs without inhibition if no backend can inhibit)
+bool operationSuspendExec(char *const cmd[], int *returnExitStatus) {
+    bool returnValue = true;
+    if (!loadXdgssLib()) {
+        return false;
     }
-    DBusMessageIter inhibitReplyMsgIter;
-    dbus_message_iter_init(d->inhibitReplyMsg, &inhibitReplyMsgIter);
-    if (dbus_message_iter_get_arg_type(&inhibitReplyMsgIter) != DBUS_TYPE_UINT32) {
-        fprintf(stderr, "Unexpected D-Bus reply\n");
+    struct operationSuspendData_t *d = &operationSuspendData;
+    *d = (struct operationSuspendData_t){0};
+    d->signalFd = -1;
+    d->pidFd = -1;
+    d->statusFd = -1;
+    int exitStatus = EXIT_FAILURE;
+    xdgssTrace("suspend_begin", "\"mode\":\"exec\",\"windows\":0,\"target\":0,\"flags\":0");
+    PROBE2(suspend_begin, 0, 0);
+    // Set up signal fd
+    sigset_t oldSigset;
+    sigprocmask(SIG_BLOCK, NULL, &oldSigset);
+    if (!createSignalFd(0, &d->signalFd)) {
         cleanReturn(false);
     }
-    dbus_message_iter_get_basic(&inhibitReplyMsgIter, &d->screenSaverInhibitCookie);
-    d->screenSaverInhibited = true;
-    dbus_message_iter_next(&inhibitReplyMsgIter);
-    if (dbus_message_iter_get_arg_type(&inhibitReplyMsgIter) != DBUS_TYPE_INVALID) {
-        fprintf(stderr, "Unexpected D-Bus reply\n");
+    // Inhibit screen saver, the command runs in any case
+    if ((d->handle = xdgssLib.suspend(0)) == NULL) {
+        fprintf(stderr, "Failed to inhibit screen saver, running %s anyway\n", cmd[0]);
+    }
+    // Spawn command
+    pid_t pid;
+    if ((pid = fork()) < 0) {
+        fprintf(stderr, "Failed to fork: %s\n", strerror(errno));
         cleanReturn(false);
     }
-    // Set custom X error handlers
-    XSetErrorHandler(operationSuspendXErrorHandler);
-    XSetIOErrorHandler(operationSuspendXIOErrorHandler);
-    // Init X
-    d->display = XOpenDisplay(NULL);
-    if (d->display == NULL) {
-        fprintf(stderr, "Failed to open X display\n");
+    if (pid == 0) {
+        sigprocmask(SIG_SETMASK, &oldSigset, NULL);
+        execvp(cmd[0], cmd);
+        fprintf(stderr, "Failed to execute %s: %s\n", cmd[0], strerror(errno));
+        _exit(127);
+    }
+    if ((d->pidFd = (int)syscall(SYS_pidfd_open, pid, 0)) < 0) {
+        fprintf(stderr, "Failed to open pidfd: %s\n", strerror(errno));
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
         cleanReturn(false);
     }
-    // Monitor X events for destruction of window (BadWindow error if window invalid)
-    XSelectInput(d->display, window, StructureNotifyMask);
-    // Flush requests and handle errors (esp. BadWindow)
-    XSync(d->display, false);
-    // Prepare select
-    int xServerFd = XConnectionNumber(d->display);
-    fd_set activeFdSet, readFdSet;
-    FD_ZERO(&activeFdSet);
-    FD_SET(d->signalFd, &activeFdSet);
-    FD_SET(xServerFd, &activeFdSet);
-    // Fork into background
-    if (fork() != 0) {
-        // Terminate immediately without cleanup
-        exit(EXIT_SUCCESS);
+    d->pid = pid;
+    // Listed only while inhibiting
+    if (d->handle != NULL) {
+        openStatusSocket();
     }
     while (true) {
-        // Flush X requests and handle pending events (required before select)
-        while (XPending(d->display) > 0) {
-            XEvent ev;
-            XNextEvent(d->display, &ev);
-            if (ev.type == DestroyNotify && ev.xdestroywindow.event == window) {
-                fprintf(stderr, "Window 0x%lx destroyed\n", window);
-                cleanReturn(true);
-            }
+        // Handle pending events (required before poll)
+        if (!xdgssLib.dispatch()) {
+            cleanReturn(false);
         }
-        readFdSet = activeFdSet;
-        if (select(FD_SETSIZE, &readFdSet, NULL, NULL, NULL) < 0) {
+        struct pollfd fds[] = {
+            {.fd = d->signalFd, .events = POLLIN},
+            {.fd = d->pidFd, .events = POLLIN},
+            {.fd = xdgssLib.get_fd(), .events = POLLIN}, // ignored if -1
+            {.fd = d->statusFd, .events = POLLIN}};
+        if (poll(fds, sizeof(fds)/sizeof(fds[0]), -1) < 0) {
             fprintf(stderr, "Failed to block on file descriptors: %s\n", strerror(errno));
             cleanReturn(false);
         }
-        if (FD_ISSET(d->signalFd, &readFdSet)) {
-            struct signalfd_siginfo siginfo;
-            if (read(d->signalFd, &siginfo, sizeof(struct signalfd_siginfo)) < 0) {
-                fprintf(stderr, "Failed to read signal fd: %s\n", strerror(errno));
+        if (fds[3].revents & POLLIN) {
+            replyStatus();
+        }
+        if (fds[0].revents & POLLIN) {
+            // Forward signal and keep inhibiting until the command exits
+            int signo = 0;
+            if (readSignalFd(d->signalFd, &signo, NULL)) {
+                kill(pid, signo);
+            }
+        }
+        if (fds[1].revents & POLLIN) {
+            int status;
+            if (waitpid(pid, &status, 0) < 0) {
+                fprintf(stderr, "Failed to wait for command: %s\n", strerror(errno));
                 cleanReturn(false);
             }
-            fprintf(stderr, "Received signal %d (%s)\n", siginfo.ssi_signo,
-                    strsignal((int)siginfo.ssi_signo));
-            cleanReturn(siginfo.ssi_signo == SIGTERM);
+            exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            d->finishReason = "exited";
+            cleanReturn(true);
         }
     }
 cleanReturn:
     if (!operationSuspendFinish()) {
         returnValue = false;
     }
+    *returnExitStatus = exitStatus;
     return returnValue;
 }
 
-bool allocReadlink(char **returnLink, const char *path, bool ignoreAccesError) {
+// Print statistics of the scan if printStats is set
+bool operationResume(unsigned long window, bool printStats) {
+    struct scanStats_t stats;
+    struct timespec wallStart, wallEnd, cpuStart, cpuEnd;
+    clock_gettime(CLOCK_MONOTONIC, &wallStart);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuStart);
+    // Kill all processes of this executable that suspend screen saver for window
+    xdgssTrace("resume_begin", "\"window\":%lu", window);
+    bool returnValue = resumeProcesses("/proc/self/exe", false, window, &stats);
+    xdgssTrace("resume_end", "\"ok\":%s", TRACE_BOOL(returnValue));
+    clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuEnd);
+    if (printStats) {
+        printf("proc_entries %lu\n", stats.procEntries);
+        printf("cgroup_members %lu\n", stats.cgroupMembers);
+        printf("unscoped %lu\n", stats.unscoped);
+        printf("pids_examined %lu\n", stats.pidsExamined);
+        printf("exe_matches %lu\n", stats.exeMatches);
+        printf("cmdlines_read %lu\n", stats.cmdlinesRead);
+        printf("suspend_matches %lu\n", stats.suspendMatches);
+        printf("window_matches %lu\n", stats.windowMatches);
+        printf("zygote_matches %lu\n", stats.zygoteMatches);
+        printf("signalled %lu\n", stats.signalled);
+        printf("eacces %lu\n", stats.eacces);
+        printf("enoent %lu\n", stats.enoent);
+        printf("cmdline_bytes %lu\n", stats.cmdlineBytes);
+        printf("syscalls %lu\n", stats.syscalls);
+        printf("wall_us %" PRId64 "\n",
+               ((int64_t)(wallEnd.tv_sec - wallStart.tv_sec) * 1000000000 +
+                (wallEnd.tv_nsec - wallStart.tv_nsec)) / 1000);
+        printf("cpu_us %" PRId64 "\n",
+               ((int64_t)(cpuEnd.tv_sec - cpuStart.tv_sec) * 1000000000 +
+                (cpuEnd.tv_nsec - cpuStart.tv_nsec)) / 1000);
+    }
+    return returnValue;
+}
+
+// Read the status line of the inhibiting process with socket path into
+// returnStatus (must be freed, returnStale is set if the process is gone)
+bool allocQueryStatus(const char *path, char **returnStatus, bool *returnStale) {
     bool returnValue = true;
-    char *link = NULL;
-    ssize_t linkSize;
-    for (size_t size = 256; true; size *= 2) {
-        if ((link = realloc(link, size)) == NULL) {
-            fprintf(stderr, "Out of memory\n");
-            cleanReturn(false);
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    struct timeval timeout = {.tv_sec = 1};
+    char *buffer = NULL;
+    size_t bufferLen = 0, bufferSize = 0;
+    ssize_t n;
+    *returnStatus = NULL;
+    *returnStale = false;
+    int fd;
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        fprintf(stderr, "Failed to create socket: %s\n", strerror(errno));
+        return false;
+    }
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        *returnStale = errno == ECONNREFUSED || errno == ENOENT;
+        if (!*returnStale) {
+            fprintf(stderr, "Failed to connect to %s: %s\n", path, strerror(errno));
         }
-        if ((linkSize = readlink(path, link, size)) < 0) {
-            if (ignoreAccesError && (errno == EACCES || errno == ENOENT)) {
-                free(link);
-                link = NULL;
-                cleanReturn(true);
+        cleanReturn(false);
+    }
+    // The line grows with the number of windows
+    do {
+        if (bufferSize - bufferLen < 2) {
+            bufferSize = bufferSize > 0 ? bufferSize * 2 : 4096;
+            char *newBuffer;
+            if ((newBuffer = realloc(buffer, bufferSize)) == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                cleanReturn(false);
             }
-            fprintf(stderr, "Failed to read link %s: %s\n", path, strerror(errno));
+            buffer = newBuffer;
+        }
+        n = recv(fd, buffer + bufferLen, bufferSize - 1 - bufferLen, 0);
+        bufferLen += n > 0 ? (size_t)n : 0;
+    } while (n > 0);
+    buffer[bufferLen] = '\0';
+    if (bufferLen == 0 || buffer[bufferLen - 1] != '\n') {
+        fprintf(stderr, "No status from %s\n", path);
+        cleanReturn(false);
+    }
+    *returnStatus = buffer;
+    buffer = NULL;
+cleanReturn:
+    free(buffer);
+    close(fd);
+    return returnValue;
+}
+
+// Find the value of key in a status line (numbers, strings without escapes and
+// arrays of numbers as written by replyStatus), NULL if it's missing
+const char *findStatusField(const char *status, const char *key, size_t *returnLen) {
+    char *keyPattern = NULL;
+    const char *value = NULL;
+    *returnLen = 0;
+    if (allocSprintf(&keyPattern, "\"%s\":", key) &&
+            (value = strstr(status, keyPattern)) != NULL) {
+        value += strlen(keyPattern);
+        *returnLen = value[0] == '[' ? strcspn(value, "]") + 1 : strcspn(value, ",}");
+    }
+    free(keyPattern);
+    return *returnLen > 0 ? value : NULL;
+}
+
+// Copy the value of key from a status line (empty if it's missing or doesn't
+// fit, never truncated)
+void statusField(const char *status, const char *key, char *buffer, size_t bufferSize) {
+    size_t valueLen;
+    const char *value = findStatusField(status, key, &valueLen);
+    if (value == NULL || valueLen >= bufferSize) {
+        valueLen = 0;
+    }
+    memcpy(buffer, value, valueLen);
+    buffer[valueLen] = '\0';
+}
+
+// Call callback with the status line of each inhibiting process, the cost
+// depends on the number of inhibitors and not on the number of processes
+bool queryInhibitors(void (*callback)(const char *, void *), void *data,
+                     unsigned long *returnStaleRemoved) {
+    bool returnValue = true;
+    char *dirPath = NULL, *path = NULL, *status = NULL;
+    DIR *dir = NULL;
+    *returnStaleRemoved = 0;
+    if (!allocStatusDirPath(&dirPath)) {
+        return false;
+    }
+    if (dirPath == NULL) {
+        fprintf(stderr, "XDG_RUNTIME_DIR is not set\n");
+        return false;
+    }
+    if ((dir = opendir(dirPath)) == NULL && errno != ENOENT) {
+        fprintf(stderr, "Failed to open %s: %s\n", dirPath, strerror(errno));
+        cleanReturn(false);
+    }
+    struct dirent *entry;
+    while (dir != NULL && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        bool stale;
+        free(path);
+        if (!allocSprintf(&path, "%s/%s", dirPath, entry->d_name)) {
             cleanReturn(false);
         }
-        if (linkSize < size) {
-            break;
+        free(status);
+        if (allocQueryStatus(path, &status, &stale)) {
+            callback(status, data);
+        } else if (stale && unlink(path) == 0) {
+            (*returnStaleRemoved)++;
         }
     }
-    link[linkSize] = '\0';
-    // Cut " (deleted)" from the end of string
-    char *suffix = " (deleted)";
-    size_t suffixLen = strlen(suffix);
-    if (linkSize >= suffixLen && strcmp(&link[(size_t)linkSize-suffixLen], suffix) == 0) {
-        linkSize -= (ssize_t)suffixLen;
-        link[linkSize] = '\0';
-    }
 cleanReturn:
-    if (!returnValue) {
-        free(link);
-        link = NULL;
+    if (dir != NULL) {
+        closedir(dir);
     }
-    *returnLink = link;
+    free(status);
+    free(path);
+    free(dirPath);
     return returnValue;
 }
 
-bool checkAndResumeProcess(int pid, const char *selfExeLink, Window window) {
+struct statusTotals_t {
+    unsigned long inhibitors;
+    long rssKb;
+    long fds;
+};
+
+void printStatus(const char *status, void *data) {
+    struct statusTotals_t *totals = data;
+    char value[32];
+    fputs(status, stdout);
+    totals->inhibitors++;
+    statusField(status, "rss_kb", value, sizeof(value));
+    totals->rssKb += strtol(value, NULL, 10);
+    statusField(status, "fds", value, sizeof(value));
+    totals->fds += strtol(value, NULL, 10);
+}
+
+// Print the status of all inhibiting processes as JSON lines
+bool operationStatus() {
+    struct statusTotals_t totals = {0};
+    unsigned long staleRemoved;
+    if (!queryInhibitors(printStatus, &totals, &staleRemoved)) {
+        return false;
+    }
+    printf("{\"inhibitors\":%lu,\"stale_removed\":%lu,\"rss_kb\":%ld,\"fds\":%ld}\n",
+           totals.inhibitors, staleRemoved, totals.rssKb, totals.fds);
+    return true;
+}
+
+void printInhibitor(const char *status, void *data) {
+    bool json = *(bool *)data;
+    char pid[32], target[32], backend[32], cookie[32], startTime[32];
+    size_t windowsLen;
+    const char *windows = findStatusField(status, "windows", &windowsLen);
+    statusField(status, "pid", pid, sizeof(pid));
+    statusField(status, "target", target, sizeof(target));
+    statusField(status, "backend", backend, sizeof(backend));
+    statusField(status, "cookie", cookie, sizeof(cookie));
+    statusField(status, "start_time", startTime, sizeof(startTime));
+    // The windows array has no size limit
+    if (windows == NULL || windows[0] != '[' || windows[windowsLen - 1] != ']') {
+        windows = "[]";
+        windowsLen = 2;
+    }
+    if (strlen(backend) < 2 || backend[0] != '"' || backend[strlen(backend) - 1] != '"') {
+        strcpy(backend, "\"unknown\"");
+    }
+    if (json) {
+        // Missing fields are written as null to keep the line valid JSON
+        printf("{\"pid\":%s,\"windows\":%.*s,\"target\":%s,\"cookie\":%s,"
+               "\"start_time\":%s,\"backend\":%s}\n",
+               pid[0] != '\0' ? pid : "null", (int)windowsLen, windows,
+               target[0] != '\0' ? target : "null", cookie[0] != '\0' ? cookie : "null",
+               startTime[0] != '\0' ? startTime : "null", backend);
+        return;
+    }
+    // Strip JSON syntax
+    backend[strlen(backend) - 1] = '\0';
+    char started[32] = "-";
+    time_t startSeconds = (time_t)strtoll(startTime, NULL, 10);
+    struct tm startTm;
+    if (startTime[0] != '\0' && localtime_r(&startSeconds, &startTm) != NULL) {
+        strftime(started, sizeof(started), "%Y-%m-%d %H:%M:%S", &startTm);
+    }
+    printf("%-8s %-24.*s %-8s %-10s %-20s %s\n", pid[0] != '\0' ? pid : "-",
+           windowsLen > 2 ? (int)windowsLen - 2 : 1, windowsLen > 2 ? windows + 1 : "-",
+           target[0] != '\0' && strcmp(target, "0") != 0 ? target : "-",
+           cookie[0] != '\0' && strcmp(cookie, "0") != 0 ? cookie : "-", started, backend + 1);
+}
+
+// Print all active inhibitions as a table or as JSON lines
+bool operationList(bool json) {
+    unsigned long staleRemoved;
+    if (!json) {
+        printf("%-8s %-24s %-8s %-10s %-20s %s\n",
+               "PID", "WINDOWS", "TARGET", "COOKIE", "STARTED", "BACKEND");
+    }
+    return queryInhibitors(printInhibitor, &json, &staleRemoved);
+}
+
+struct serveClient_t {
+    int inFd, outFd;
+    char line[256];
+    size_t lineLen;
+    struct serveClient_t *next;
+};
+
+struct serveHandle_t {
+    xdgss_handle *handle;
+    unsigned long window;
+    struct serveHandle_t *next;
+};
+
+struct operationServeData_t {
+    int signalFd;
+    int listenFd;
+    const char *socketPath;
+    struct serveClient_t *clients;
+    struct serveHandle_t *handles;
+} operationServeData;
+
+int64_t monotonicMicroseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Release the inhibitions of destroyed windows
+void serveDispatch() {
+    struct operationServeData_t *d = &operationServeData;
+    xdgssLib.dispatch();
+    for (struct serveHandle_t **h = &d->handles; *h != NULL;) {
+        if (xdgssLib.is_active((*h)->handle)) {
+            h = &(*h)->next;
+            continue;
+        }
+        struct serveHandle_t *inactive = *h;
+        *h = inactive->next;
+        fprintf(stderr, "Window 0x%lx destroyed\n", inactive->window);
+        xdgssLib.resume(inactive->handle);
+        free(inactive);
+    }
+}
+
+bool serveSuspend(unsigned long window) {
+    struct operationServeData_t *d = &operationServeData;
+    struct serveHandle_t *h;
+    if ((h = malloc(sizeof(struct serveHandle_t))) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    if ((h->handle = xdgssLib.suspend(window)) == NULL) {
+        free(h);
+        return false;
+    }
+    h->window = window;
+    h->next = d->handles;
+    d->handles = h;
+    return true;
+}
+
+// Release the inhibitions of window held by this server (no /proc scan)
+bool serveResume(unsigned long window) {
     bool returnValue = true;
-    char *exePath = NULL, *cmdlinePath = NULL, *exeLink = NULL, *cmdline = NULL;
-    int cmdlineFd = -1;
-    // Check if process is same exe
-    if (!allocSprintf(&exePath, "/proc/%d/exe", pid)) {
-        cleanReturn(false);
+    struct operationServeData_t *d = &operationServeData;
+    for (struct serveHandle_t **h = &d->handles; *h != NULL;) {
+        if ((*h)->window != window) {
+            h = &(*h)->next;
+            continue;
+        }
+        struct serveHandle_t *resumed = *h;
+        *h = resumed->next;
+        if (!xdgssLib.resume(resumed->handle)) {
+            returnValue = false;
+        }
+        free(resumed);
     }
-    if (!allocReadlink(&exeLink, exePath, true)) {
-        cleanReturn(false);
+    return returnValue;
+}
+
+// Run command line "suspend WindowID" or "resume WindowID" and reply with
+// "ok|error LATENCY_US"
+bool serveCommand(struct serveClient_t *c) {
+    int64_t startTime = monotonicMicroseconds();
+    bool success = false;
+    unsigned long window;
+    char *arg = strchr(c->line, ' ');
+    if (arg != NULL) {
+        *arg++ = '\0';
     }
-    if (exeLink == NULL) {
-        cleanReturn(true);
+    if (arg == NULL) {
+        fprintf(stderr, "Invalid command: %s\n", c->line);
+    } else if (!parseWindow(arg, &window)) {
+        success = false;
+    } else if (strcmp(c->line, "suspend") == 0) {
+        success = serveSuspend(window);
+    } else if (strcmp(c->line, "resume") == 0) {
+        success = serveResume(window);
+    } else {
+        fprintf(stderr, "Invalid command: %s\n", c->line);
     }
-    // Check command line arguments of process
-    if (!allocSprintf(&cmdlinePath, "/proc/%d/cmdline", pid)) {
-        cleanReturn(false);
+    char reply[64];
+    int replyLen = snprintf(reply, sizeof(reply), "%s %" PRId64 "\n",
+                            success ? "ok" : "error", monotonicMicroseconds() - startTime);
+    // Don't raise SIGPIPE for sockets of disconnected clients
+    if ((c->outFd == c->inFd ? send(c->outFd, reply, (size_t)replyLen, MSG_NOSIGNAL)
+                             : write(c->outFd, reply, (size_t)replyLen)) != replyLen) {
+        return false;
     }
-    if ((cmdlineFd = open(cmdlinePath, O_RDONLY)) < 0) {
-        if (errno == EACCES || errno == ENOENT) {
-            cleanReturn(true);
+    return true;
+}
+
+// Read commands of client (false if it disconnected)
+bool serveClient(struct serveClient_t *c) {
+    ssize_t readLen = read(c->inFd, &c->line[c->lineLen], sizeof(c->line) - c->lineLen);
+    if (readLen <= 0) {
+        return false;
+    }
+    c->lineLen += (size_t)readLen;
+    char *lineEnd;
+    while ((lineEnd = memchr(c->line, '\n', c->lineLen)) != NULL) {
+        *lineEnd = '\0';
+        size_t consumedLen = (size_t)(lineEnd - c->line) + 1;
+        if (!serveCommand(c)) {
+            return false;
         }
-        fprintf(stderr, "Failed to open %s: %s\n", cmdlinePath, strerror(errno));
+        memmove(c->line, &c->line[consumedLen], c->lineLen - consumedLen);
+        c->lineLen -= consumedLen;
+    }
+    if (c->lineLen == sizeof(c->line)) {
+        fprintf(stderr, "Command too long\n");
+        return false;
+    }
+    return true;
+}
+
+bool addServeClient(int inFd, int outFd) {
+    struct operationServeData_t *d = &operationServeData;
+    struct serveClient_t *c;
+    if ((c = calloc(1, sizeof(struct serveClient_t))) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    c->inFd = inFd;
+    c->outFd = outFd;
+    c->next = d->clients;
+    d->clients = c;
+    return true;
+}
+
+bool operationServe(const char *socketPath) {
+    bool returnValue = true;
+    if (!loadXdgssLib()) {
+        return false;
+    }
+    struct operationServeData_t *d = &operationServeData;
+    *d = (struct operationServeData_t){0};
+    d->signalFd = -1;
+    d->listenFd = -1;
+    struct pollfd *fds = NULL;
+    if (!createSignalFd(0, &d->signalFd)) {
         cleanReturn(false);
     }
-    ssize_t cmdlineSize = 0;
-    for (size_t size = 1024; true; size *= 2) {
-        if ((cmdline = realloc(cmdline, size)) == NULL) {
+    if (socketPath == NULL) {
+        if (!addServeClient(STDIN_FILENO, STDOUT_FILENO)) {
+            cleanReturn(false);
+        }
+    } else {
+        if (!listenUnixSocket(socketPath, &d->listenFd)) {
+            cleanReturn(false);
+        }
+        d->socketPath = socketPath;
+    }
+    while (true) {
+        // Handle pending events (required before poll)
+        serveDispatch();
+        // Stop when stdin is closed
+        if (d->listenFd == -1 && d->clients == NULL) {
+            cleanReturn(true);
+        }
+        size_t fdsLen = 3;
+        for (struct serveClient_t *c = d->clients; c != NULL; c = c->next) {
+            fdsLen++;
+        }
+        free(fds);
+        if ((fds = calloc(fdsLen, sizeof(struct pollfd))) == NULL) {
             fprintf(stderr, "Out of memory\n");
             cleanReturn(false);
         }
-        ssize_t cmdlinePartSize = read(cmdlineFd, &cmdline[cmdlineSize], size-(size_t)cmdlineSize);
-        if (cmdlinePartSize < 0) {
-            fprintf(stderr, "Failed to read cmdline: %s\n", strerror(errno));
+        fds[0] = (struct pollfd){.fd = d->signalFd, .events = POLLIN};
+        fds[1] = (struct pollfd){.fd = xdgssLib.get_fd(), .events = POLLIN};
+        fds[2] = (struct pollfd){.fd = d->listenFd, .events = POLLIN};
+        size_t i = 3;
+        for (struct serveClient_t *c = d->clients; c != NULL; c = c->next) {
+            fds[i++] = (struct pollfd){.fd = c->inFd, .events = POLLIN};
+        }
+        if (poll(fds, fdsLen, -1) < 0) {
+            fprintf(stderr, "Failed to block on file descriptors: %s\n", strerror(errno));
             cleanReturn(false);
         }
-        cmdlineSize += cmdlinePartSize;
-        if (cmdlineSize < size) {
-            break;
+        if (fds[0].revents & POLLIN) {
+            int signo = 0;
+            readSignalFd(d->signalFd, &signo, NULL);
+            cleanReturn(signo == SIGTERM);
+        }
+        i = 3;
+        for (struct serveClient_t **c = &d->clients; *c != NULL; i++) {
+            if (fds[i].revents == 0 || serveClient(*c)) {
+                c = &(*c)->next;
+                continue;
+            }
+            struct serveClient_t *disconnected = *c;
+            *c = disconnected->next;
+            if (disconnected->inFd != STDIN_FILENO) {
+                close(disconnected->inFd);
+            }
+            free(disconnected);
+        }
+        if (fds[2].revents & POLLIN) {
+            int clientFd;
+            if ((clientFd = accept4(d->listenFd, NULL, NULL, SOCK_CLOEXEC)) < 0) {
+                fprintf(stderr, "Failed to accept connection: %s\n", strerror(errno));
+            } else if (!addServeClient(clientFd, clientFd)) {
+                close(clientFd);
+            }
         }
     }
-    if (cmdlineSize < 1 || cmdline[cmdlineSize-1] != '\0') {
-        fprintf(stderr, "Invalid cmdline encountered\n");
-        cleanReturn(false);
+cleanReturn:
+    free(fds);
+    while (d->clients != NULL) {
+        struct serveClient_t *c = d->clients;
+        d->clients = c->next;
+        if (c->inFd != STDIN_FILENO) {
+            close(c->inFd);
+        }
+        free(c);
     }
-    // check argc >= 1 and argv[1] is "suspend"
-    size_t cmdlineArg1Start = strlen(cmdline) + NULL_BYTE_LEN;
-    if (cmdlineArg1Start >= cmdlineSize ||
-            strcmp(&cmdline[cmdlineArg1Start], "suspend") != 0) {
-        cleanReturn(true);
+    while (d->handles != NULL) {
+        struct serveHandle_t *h = d->handles;
+        d->handles = h->next;
+        if (!xdgssLib.resume(h->handle)) {
+            returnValue = false;
+        }
+        free(h);
     }
-    // check argc >= 2 and argv[2] is window
-    size_t cmdlineArg2Start = (
-        cmdlineArg1Start + strlen(&cmdline[cmdlineArg1Start]) + NULL_BYTE_LEN);
-    if (cmdlineArg2Start >= cmdlineSize) {
-        cleanReturn(true);
+    xdgssLib.shutdown();
+    if (d->listenFd != -1) {
+        close(d->listenFd);
+        unlink(d->socketPath);
     }
-    char *windowEnd;
-    Window cmdlineWindow = strtoul(&cmdline[cmdlineArg2Start], &windowEnd, 0);
-    if (cmdline[cmdlineArg2Start] == '\0' || windowEnd[0] != '\0' || cmdlineWindow != window) {
-        cleanReturn(true);
-    }
-    // Check that argc == 3
-    size_t cmdlineArgsEnd = (
-        cmdlineArg2Start + strlen(&cmdline[cmdlineArg2Start]) + NULL_BYTE_LEN);
-    if (cmdlineArgsEnd != cmdlineSize) {
-        cleanReturn(true);
-    }
-    // Send SIGTERM to process
-    if (kill(pid, SIGTERM) < 0) {
-        if (errno == EPERM || errno == ESRCH) {
-            cleanReturn(true);
+    if (d->signalFd != -1) {
+        close(d->signalFd);
+    }
+    return returnValue;
+}
+
+struct zygoteChild_t {
+    pid_t pid;
+    unsigned long window;
+    struct zygoteChild_t *next;
+};
+
+struct operationZygoteData_t {
+    int signalFd;
+    int listenFd;
+    const char *socketPath;
+    struct zygoteChild_t *children;
+    // Registration as unscoped (NULL if the zygote joined the scope), the
+    // children register themselves as well
+    char *unscopedPath;
+} operationZygoteData;
+
+// Inhibit in a forked child that replies to the client and then behaves like
+// the background process of suspend
+bool zygoteSuspend(int clientFd, unsigned long window) {
+    struct operationZygoteData_t *d = &operationZygoteData;
+    struct zygoteChild_t *child;
+    if ((child = malloc(sizeof(struct zygoteChild_t))) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    if ((child->pid = fork()) < 0) {
+        fprintf(stderr, "Failed to fork: %s\n", strerror(errno));
+        free(child);
+        return false;
+    }
+    if (child->pid == 0) {
+        struct operationSuspendData_t *s = &operationSuspendData;
+        *s = (struct operationSuspendData_t){0};
+        s->pidFd = -1;
+        s->statusFd = -1;
+        s->windows = &window;
+        s->windowsLen = 1;
+        if (d->unscopedPath != NULL) {
+            free(d->unscopedPath);
+            d->unscopedPath = NULL;
+            if (markUnscoped(getpid(), true)) {
+                allocUnscopedPath(getpid(), &s->unscopedPath);
+            }
         }
-        fprintf(stderr, "Failed to kill process %d: %s\n", pid, strerror(errno));
-        cleanReturn(false);
+        close(d->listenFd);
+        close(d->signalFd);
+        // Sent by resume to all processes of the zygote, the child only reacts
+        // if it's for its window
+        if (!createSignalFd(XDGSS_RELEASE_WINDOW_SIGNAL, &s->signalFd)) {
+            _exit(EXIT_FAILURE);
+        }
+        s->handle = xdgssLib.suspend(window);
+        const char *reply = s->handle != NULL ? "ok\n" : "error\n";
+        send(clientFd, reply, strlen(reply), MSG_NOSIGNAL);
+        close(clientFd);
+        if (s->handle == NULL) {
+            operationSuspendFinish();
+            _exit(EXIT_FAILURE);
+        }
+        // Only the state in operationSuspendData is needed from now on
+        free(child);
+        while (d->children != NULL) {
+            struct zygoteChild_t *next = d->children->next;
+            free(d->children);
+            d->children = next;
+        }
+        openStatusSocket();
+        reduceFootprint();
+        _exit(operationSuspendWait() ? EXIT_SUCCESS : EXIT_FAILURE);
     }
-cleanReturn:
-    if (cmdlineFd != -1) {
-        close(cmdlineFd);
+    child->window = window;
+    child->next = d->children;
+    d->children = child;
+    return true;
+}
+
+// Stop the children that inhibit for window
+void zygoteResume(unsigned long window) {
+    struct operationZygoteData_t *d = &operationZygoteData;
+    for (struct zygoteChild_t *child = d->children; child != NULL; child = child->next) {
+        if (child->window == window && kill(child->pid, SIGTERM) < 0) {
+            fprintf(stderr, "Failed to kill process %d: %s\n", child->pid, strerror(errno));
+        }
     }
-    free(exeLink);
-    free(cmdline);
-    free(exePath);
-    free(cmdlinePath);
-    return returnValue;
 }
 
-bool operationResume(const char *prog, Window window) {
-    // Kill all processes that suspend screen saver for window
+void zygoteReapChildren() {
+    struct operationZygoteData_t *d = &operationZygoteData;
+    pid_t pid;
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+        for (struct zygoteChild_t **child = &d->children; *child != NULL;
+                child = &(*child)->next) {
+            if ((*child)->pid == pid) {
+                struct zygoteChild_t *exited = *child;
+                *child = exited->next;
+                free(exited);
+                break;
+            }
+        }
+    }
+}
+
+// Read one command line "suspend WindowID" or "resume WindowID" from client,
+// the reply is "ok" or "error"
+void zygoteClient(int clientFd) {
+    char line[64];
+    size_t lineLen = 0;
+    char *lineEnd = NULL;
+    // Don't let a stalled client block the zygote
+    struct timeval timeout = {.tv_sec = 1};
+    setsockopt(clientFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    while (lineEnd == NULL && lineLen < sizeof(line)) {
+        ssize_t readLen = read(clientFd, &line[lineLen], sizeof(line) - lineLen);
+        if (readLen <= 0) {
+            return;
+        }
+        lineEnd = memchr(&line[lineLen], '\n', (size_t)readLen);
+        lineLen += (size_t)readLen;
+    }
+    if (lineEnd == NULL) {
+        fprintf(stderr, "Command too long\n");
+        return;
+    }
+    *lineEnd = '\0';
+    unsigned long window;
+    char *arg = strchr(line, ' ');
+    if (arg != NULL) {
+        *arg++ = '\0';
+    }
+    bool success = false;
+    if (arg == NULL) {
+        fprintf(stderr, "Invalid command: %s\n", line);
+    } else if (!parseWindow(arg, &window)) {
+        success = false;
+    } else if (strcmp(line, "suspend") == 0) {
+        // The child replies
+        if (zygoteSuspend(clientFd, window)) {
+            return;
+        }
+    } else if (strcmp(line, "resume") == 0) {
+        zygoteResume(window);
+        success = true;
+    } else {
+        fprintf(stderr, "Invalid command: %s\n", line);
+    }
+    const char *reply = success ? "ok\n" : "error\n";
+    send(clientFd, reply, strlen(reply), MSG_NOSIGNAL);
+}
+
+bool operationZygote(const char *socketPath) {
     bool returnValue = true;
-    char *selfExeLink = NULL;
-    DIR *procDir = NULL;
-    if (!allocReadlink(&selfExeLink, "/proc/self/exe", false)) {
+    // Release signals of resume are meant for the children, blocked (not
+    // read) so that children inherit the mask and don't lose those that
+    // arrive before they create their signal fd. Blocked first, resume
+    // matches the command line of this process as soon as it runs and the
+    // default action of the signal would end it.
+    sigset_t releaseSigset;
+    sigemptyset(&releaseSigset);
+    sigaddset(&releaseSigset, XDGSS_RELEASE_WINDOW_SIGNAL);
+    if (sigprocmask(SIG_BLOCK, &releaseSigset, NULL) < 0) {
+        fprintf(stderr, "Failed to block signals: %s\n", strerror(errno));
+        return false;
+    }
+    if (!loadXdgssLib()) {
+        return false;
+    }
+    struct operationZygoteData_t *d = &operationZygoteData;
+    *d = (struct operationZygoteData_t){0};
+    d->signalFd = -1;
+    d->listenFd = -1;
+    if (!createSignalFd(SIGCHLD, &d->signalFd)) {
         cleanReturn(false);
     }
-    // Search processes in /proc
-    if ((procDir = opendir("/proc")) == NULL) {
-        fprintf(stderr, "Failed to open /proc: %s\n", strerror(errno));
+    // Children are forked in the scope
+    if (!joinInhibitorScope(&d->unscopedPath)) {
         cleanReturn(false);
     }
-    struct dirent *procDirEnt;
-    while ((procDirEnt = readdir(procDir)) != NULL) {
-        for (int i = 0; procDirEnt->d_name[i] != '\0'; i++) {
-            if (!isdigit(procDirEnt->d_name[i])) {
-                continue;
+    if (!listenUnixSocket(socketPath, &d->listenFd)) {
+        cleanReturn(false);
+    }
+    d->socketPath = socketPath;
+    while (true) {
+        struct pollfd fds[] = {
+            {.fd = d->signalFd, .events = POLLIN},
+            {.fd = d->listenFd, .events = POLLIN}};
+        if (poll(fds, sizeof(fds)/sizeof(fds[0]), -1) < 0) {
+            fprintf(stderr, "Failed to block on file descriptors: %s\n", strerror(errno));
+            cleanReturn(false);
+        }
+        if (fds[0].revents & POLLIN) {
+            int signo = 0;
+            readSignalFd(d->signalFd, &signo, NULL);
+            if (signo != SIGCHLD) {
+                cleanReturn(signo == SIGTERM);
             }
+            zygoteReapChildren();
         }
-        int pid = atoi(procDirEnt->d_name);
-        if (!checkAndResumeProcess(pid, selfExeLink, window)) {
-            returnValue = false;
-            fprintf(stderr, "Continuing\n");
+        if (fds[1].revents & POLLIN) {
+            int clientFd;
+            if ((clientFd = accept4(d->listenFd, NULL, NULL, SOCK_CLOEXEC)) < 0) {
+                fprintf(stderr, "Failed to accept connection: %s\n", strerror(errno));
+                continue;
+            }
+            zygoteClient(clientFd);
+            close(clientFd);
         }
     }
 cleanReturn:
-    if (procDir != NULL) {
-        closedir(procDir);
+    // Children keep their inhibitions
+    while (d->children != NULL) {
+        struct zygoteChild_t *child = d->children;
+        d->children = child->next;
+        free(child);
+    }
+    if (d->listenFd != -1) {
+        close(d->listenFd);
+        unlink(d->socketPath);
     }
-    free(selfExeLink);
+    if (d->signalFd != -1) {
+        close(d->signalFd);
+    }
+    removeUnscoped(&d->unscopedPath);
     return returnValue;
 }
 
 void help(const char *prog) {
     printf("%s - command line tool for controlling the screensaver\n\n", prog);
-    printf("%s suspend WindowID\n", prog);
-    printf("%s resume WindowID\n", prog);
+    printf("%s suspend [--watch-owner] [--fast-teardown] WindowID [WindowID...]\n", prog);
+    printf("%s suspend [--fast-teardown] --pid PID\n", prog);
+    printf("%s suspend --exec [--] COMMAND [ARG...]\n", prog);
+    printf("%s resume [--stats] WindowID\n", prog);
+    printf("%s list [--json]\n", prog);
+    printf("%s status\n", prog);
+    printf("%s serve [--socket PATH]\n", prog);
+    printf("%s zygote --socket PATH\n", prog);
     printf("%s { --help | --version }\n", prog);
 }
 
 int main(int argc, char *argv[]) {
     // Parse command line arguments
-    Window window;
-    if (argc == 3) {
-        bool (*op)(const char*, Window);
-        if (strcmp(argv[1], "suspend") == 0) {
-            op = operationSuspend;
-        } else if (strcmp(argv[1], "resume") == 0) {
-            op = operationResume;
-        } else {
+    unsigned long window;
+    if (argc == 3 && strcmp(argv[1], "resume") == 0) {
+        if (!parseWindow(argv[2], &window)) {
+            return EXIT_FAILURE;
+        }
+        return operationResume(window, false) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (argc == 4 && strcmp(argv[1], "resume") == 0 && strcmp(argv[2], "--stats") == 0) {
+        if (!parseWindow(argv[3], &window)) {
+            return EXIT_FAILURE;
+        }
+        return operationResume(window, true) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (argc >= 4 && strcmp(argv[1], "suspend") == 0 && strcmp(argv[2], "--exec") == 0) {
+        char **cmd = &argv[3];
+        if (strcmp(cmd[0], "--") == 0) {
+            cmd++;
+        }
+        if (cmd[0] == NULL) {
             goto invalidArguments;
         }
-        char *windowEnd;
-        window = strtoul(argv[2], &windowEnd, 0);
-        if (argv[2][0] == '\0' || windowEnd[0] != '\0') {
-            fprintf(stderr, "Invalid WindowId: %s\n", argv[2]);
+        int exitStatus;
+        return operationSuspendExec(cmd, &exitStatus) ? exitStatus : EXIT_FAILURE;
+    }
+    if (argc >= 3 && strcmp(argv[1], "suspend") == 0) {
+        unsigned int flags = 0;
+        char **args = &argv[2];
+        const char *pidArg = NULL;
+        for (; args[0] != NULL && strncmp(args[0], "--", 2) == 0; args++) {
+            if (strcmp(args[0], "--watch-owner") == 0) {
+                flags |= XDGSS_WATCH_OWNER;
+            } else if (strcmp(args[0], "--fast-teardown") == 0) {
+                flags |= XDGSS_NO_REPLY;
+            } else if (strcmp(args[0], "--pid") == 0 && args[1] != NULL) {
+                pidArg = (++args)[0];
+            } else {
+                goto invalidArguments;
+            }
+        }
+        if (pidArg != NULL) {
+            // No windows and no window owner to watch with --pid
+            if (args[0] != NULL || (flags & XDGSS_WATCH_OWNER)) {
+                goto invalidArguments;
+            }
+            char *pidEnd;
+            long pid = strtol(pidArg, &pidEnd, 10);
+            if (pidArg[0] == '\0' || pidEnd[0] != '\0' || pid <= 0 || pid > INT_MAX) {
+                fprintf(stderr, "Invalid PID: %s\n", pidArg);
+                return EXIT_FAILURE;
+            }
+            return operationSuspend(NULL, 0, flags, (pid_t)pid) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        size_t windowsLen = (size_t)(&argv[argc] - args);
+        unsigned long *windows;
+        if (windowsLen == 0) {
+            goto invalidArguments;
+        }
+        if ((windows = calloc(windowsLen, sizeof(unsigned long))) == NULL) {
+            fprintf(stderr, "Out of memory\n");
             return EXIT_FAILURE;
         }
-        return op(argv[0], window) ? EXIT_SUCCESS : EXIT_FAILURE;
+        for (size_t i = 0; i < windowsLen; i++) {
+            if (!parseWindow(args[i], &windows[i])) {
+                return EXIT_FAILURE;
+            }
+        }
+        return operationSuspend(windows, windowsLen, flags, 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (argc == 2 && strcmp(argv[1], "list") == 0) {
+        return operationList(false) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (argc == 3 && strcmp(argv[1], "list") == 0 && strcmp(argv[2], "--json") == 0) {
+        return operationList(true) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (argc == 2 && strcmp(argv[1], "status") == 0) {
+        return operationStatus() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (argc == 2 && strcmp(argv[1], "serve") == 0) {
+        return operationServe(NULL) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (argc == 4 && strcmp(argv[1], "serve") == 0 && strcmp(argv[2], "--socket") == 0) {
+        return operationServe(argv[3]) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (argc == 4 && strcmp(argv[1], "zygote") == 0 && strcmp(argv[2], "--socket") == 0) {
+        return operationZygote(argv[3]) ? EXIT_SUCCESS : EXIT_FAILURE;
     }
     if (argc == 2 && strcmp(argv[1], "--help") == 0) {
         help(argv[0]);
@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// LD_PRELOAD library that services "xdg-screensaver suspend|resume WindowID"
+// with libxdgss instead of spawning the command.
+//
+// All requests are handled by a service thread of the process that loaded the
+// library, so the inhibitions of the application and of its forked children
+// (that would exec the command) share one in-process inhibitor.
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <limits.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "xdgss.h"
+
+#define cleanReturn(value) do { returnValue = value; goto cleanReturn; } while (false)
+
+// The module is built with hidden visibility, only the interposed functions
+// are exported so that no other symbols of the application get overridden
+#define PRELOAD_EXPORT __attribute__((visibility("default")))
+
+enum preloadCommand_t {
+    PRELOAD_COMMAND_SUSPEND,
+    PRELOAD_COMMAND_RESUME,
+};
+
+struct preloadRequest_t {
+    enum preloadCommand_t command;
+    unsigned long window;
+    // Program that would have been executed (empty if it wasn't found)
+    char exe[PATH_MAX];
+};
+
+struct preloadHandle_t {
+    xdgss_handle *handle;
+    struct preloadHandle_t *next;
+};
+
+struct preloadData_t {
+    pid_t ownerPid;
+    // Requests are sent to requestFds[1] (also from forked children) and
+    // received by the service thread on requestFds[0]
+    int requestFds[2];
+    bool serviceRunning;
+    // Only used by the service thread
+    struct preloadHandle_t *handles;
+} preloadData = {.requestFds = {-1, -1}};
+
+// Check if argv is "xdg-screensaver suspend|resume WindowID"
+bool parseCommand(char *const argv[], enum preloadCommand_t *returnCommand,
+                  unsigned long *returnWindow) {
+    if (argv == NULL || argv[0] == NULL || argv[1] == NULL || argv[2] == NULL ||
+            argv[3] != NULL) {
+        return false;
+    }
+    const char *prog = strrchr(argv[0], '/');
+    prog = prog != NULL ? prog + 1 : argv[0];
+    if (strcmp(prog, "xdg-screensaver") != 0) {
+        return false;
+    }
+    if (strcmp(argv[1], "suspend") == 0) {
+        *returnCommand = PRELOAD_COMMAND_SUSPEND;
+    } else if (strcmp(argv[1], "resume") == 0) {
+        *returnCommand = PRELOAD_COMMAND_RESUME;
+    } else {
+        return false;
+    }
+    char *windowEnd;
+    *returnWindow = strtoul(argv[2], &windowEnd, 0);
+    return argv[2][0] != '\0' && windowEnd[0] == '\0';
+}
+
+// Find the program that execvp would execute for file (false if not found)
+bool resolveProgram(const char *file, char returnPath[PATH_MAX]) {
+    if (strchr(file, '/') != NULL) {
+        return snprintf(returnPath, PATH_MAX, "%s", file) < PATH_MAX;
+    }
+    const char *path = getenv("PATH");
+    if (path == NULL) {
+        path = "/usr/local/bin:/bin:/usr/bin";
+    }
+    while (true) {
+        size_t dirLen = strcspn(path, ":");
+        if (snprintf(returnPath, PATH_MAX, "%.*s%s%s", (int)dirLen, path,
+                     dirLen > 0 ? "/" : "", file) < PATH_MAX &&
+                access(returnPath, X_OK) == 0) {
+            return true;
+        }
+        if (path[dirLen] == '\0') {
+            return false;
+        }
+        path += dirLen + 1;
+    }
+}
+
+// Check if the shell command is "xdg-screensaver suspend|resume WindowID"
+// (only plain words separated by blanks)
+bool parseShellCommand(const char *cmd, enum preloadCommand_t *returnCommand,
+                       unsigned long *returnWindow) {
+    char words[3][64];
+    char *argv[4] = {words[0], words[1], words[2], NULL};
+    int argc = 0;
+    const char *c = cmd;
+    while (true) {
+        while (*c == ' ' || *c == '\t') {
+            c++;
+        }
+        if (*c == '\0') {
+            break;
+        }
+        if (argc == 3) {
+            return false;
+        }
+        size_t wordLen = 0;
+        for (; *c != '\0' && *c != ' ' && *c != '\t'; c++) {
+            if (!isalnum((unsigned char)*c) && strchr("/._-", *c) == NULL) {
+                return false;
+            }
+            if (wordLen + 1 >= sizeof(words[0])) {
+                return false;
+            }
+            words[argc][wordLen++] = *c;
+        }
+        words[argc++][wordLen] = '\0';
+    }
+    return argc == 3 && parseCommand(argv, returnCommand, returnWindow);
+}
+
+// First word of a shell command accepted by parseShellCommand
+void shellCommandProgram(const char *cmd, char returnFile[64]) {
+    cmd += strspn(cmd, " \t");
+    size_t fileLen = strcspn(cmd, " \t");
+    snprintf(returnFile, 64, "%.*s", (int)fileLen, cmd);
+}
+
+// Free handles whose window got destroyed
+void pruneHandles() {
+    struct preloadData_t *d = &preloadData;
+    for (struct preloadHandle_t **h = &d->handles; *h != NULL;) {
+        if (xdgss_is_active((*h)->handle)) {
+            h = &(*h)->next;
+            continue;
+        }
+        struct preloadHandle_t *inactive = *h;
+        *h = inactive->next;
+        xdgss_resume(inactive->handle);
+        free(inactive);
+    }
+}
+
+bool runRequest(const struct preloadRequest_t *request) {
+    struct preloadData_t *d = &preloadData;
+    if (request->command == PRELOAD_COMMAND_RESUME) {
+        // Also resumes suspensions of the real xdg-screensaver (that the
+        // application would have executed)
+        return xdgss_resume_window(request->exe[0] != '\0' ? request->exe : NULL,
+                                   request->window);
+    }
+    struct preloadHandle_t *h;
+    if ((h = malloc(sizeof(struct preloadHandle_t))) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    if ((h->handle = xdgss_suspend(request->window)) == NULL) {
+        free(h);
+        return false;
+    }
+    h->next = d->handles;
+    d->handles = h;
+    return true;
+}
+
+// Receive request with the fd for the reply and answer it
+void serviceRequest() {
+    struct preloadData_t *d = &preloadData;
+    struct preloadRequest_t request;
+    struct iovec iov = {.iov_base = &request, .iov_len = sizeof(request)};
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = control.buf, .msg_controllen = sizeof(control.buf)};
+    ssize_t requestLen = recvmsg(d->requestFds[0], &msg, MSG_CMSG_CLOEXEC);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS) {
+        return;
+    }
+    int replyFd;
+    memcpy(&replyFd, CMSG_DATA(cmsg), sizeof(int));
+    if (requestLen == sizeof(request)) {
+        char status = runRequest(&request) ? EXIT_SUCCESS : EXIT_FAILURE;
+        if (write(replyFd, &status, sizeof(status)) < 0) {
+            fprintf(stderr, "Failed to reply: %s\n", strerror(errno));
+        }
+    }
+    close(replyFd);
+}
+
+void *serviceThread(void *arg) {
+    struct preloadData_t *d = &preloadData;
+    while (true) {
+        // Handle pending events (required before poll)
+        xdgss_dispatch();
+        pruneHandles();
+        struct pollfd fds[] = {
+            {.fd = d->requestFds[0], .events = POLLIN},
+            {.fd = xdgss_get_fd(), .events = POLLIN}}; // ignored if -1
+        if (poll(fds, sizeof(fds)/sizeof(fds[0]), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Failed to block on file descriptors: %s\n", strerror(errno));
+            return NULL;
+        }
+        if (fds[0].revents & POLLIN) {
+            serviceRequest();
+        }
+    }
+}
+
+__attribute__((constructor))
+void preloadInit() {
+    struct preloadData_t *d = &preloadData;
+    d->ownerPid = getpid();
+    // xdg-screensaver inherits LD_PRELOAD when its spawn isn't intercepted and
+    // uses libxdgss itself, which is not thread-safe
+    if (strcmp(program_invocation_short_name, "xdg-screensaver") == 0) {
+        return;
+    }
+    // Forked children inherit the socket but executed programs don't
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, d->requestFds) < 0) {
+        return;
+    }
+    // Signals are left to the threads of the application
+    sigset_t allSigset, oldSigset;
+    sigfillset(&allSigset);
+    pthread_sigmask(SIG_SETMASK, &allSigset, &oldSigset);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, serviceThread, NULL) == 0) {
+        pthread_detach(thread);
+        d->serviceRunning = true;
+    }
+    pthread_sigmask(SIG_SETMASK, &oldSigset, NULL);
+}
+
+// Let the service thread run the command that would have executed file (false
+// if it's not reachable)
+bool sendRequest(enum preloadCommand_t command, unsigned long window, const char *file,
+                 int *returnStatus) {
+    bool returnValue = true;
+    struct preloadData_t *d = &preloadData;
+    int replyFds[2] = {-1, -1};
+    if (!d->serviceRunning) {
+        cleanReturn(false);
+    }
+    if (pipe2(replyFds, O_CLOEXEC) < 0) {
+        cleanReturn(false);
+    }
+    struct preloadRequest_t request = {.command = command, .window = window};
+    if (command == PRELOAD_COMMAND_RESUME && !resolveProgram(file, request.exe)) {
+        request.exe[0] = '\0';
+    }
+    struct iovec iov = {.iov_base = &request, .iov_len = sizeof(request)};
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control = {0};
+    struct msghdr msg = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = control.buf, .msg_controllen = sizeof(control.buf)};
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &replyFds[1], sizeof(int));
+    if (sendmsg(d->requestFds[1], &msg, MSG_NOSIGNAL) < 0) {
+        cleanReturn(false);
+    }
+    close(replyFds[1]);
+    replyFds[1] = -1;
+    char status;
+    ssize_t statusLen;
+    while ((statusLen = read(replyFds[0], &status, sizeof(status))) < 0 && errno == EINTR);
+    if (statusLen != sizeof(status)) {
+        // Owner exited or the service thread is gone
+        cleanReturn(false);
+    }
+    *returnStatus = status;
+cleanReturn:
+    for (int i = 0; i < 2; i++) {
+        if (replyFds[i] != -1) {
+            close(replyFds[i]);
+        }
+    }
+    return returnValue;
+}
+
+// Create a child that exits immediately with status, so that callers of
+// posix_spawn still get a process to wait for
+int spawnExited(pid_t *pid, int status) {
+    pid_t child = vfork();
+    if (child < 0) {
+        return errno;
+    }
+    if (child == 0) {
+        _exit(status);
+    }
+    if (pid != NULL) {
+        *pid = child;
+    }
+    return 0;
+}
+
+#define realFunction(name) ((__typeof__(&name))dlsym(RTLD_NEXT, #name))
+
+PRELOAD_EXPORT int posix_spawn(pid_t *pid, const char *path,
+                const posix_spawn_file_actions_t *fileActions,
+                const posix_spawnattr_t *attrp, char *const argv[], char *const envp[]) {
+    enum preloadCommand_t command;
+    unsigned long window;
+    int status;
+    if (parseCommand(argv, &command, &window) && sendRequest(command, window, path, &status)) {
+        return spawnExited(pid, status);
+    }
+    return realFunction(posix_spawn)(pid, path, fileActions, attrp, argv, envp);
+}
+
+PRELOAD_EXPORT int posix_spawnp(pid_t *pid, const char *file,
+                 const posix_spawn_file_actions_t *fileActions,
+                 const posix_spawnattr_t *attrp, char *const argv[], char *const envp[]) {
+    enum preloadCommand_t command;
+    unsigned long window;
+    int status;
+    if (parseCommand(argv, &command, &window) && sendRequest(command, window, file, &status)) {
+        return spawnExited(pid, status);
+    }
+    return realFunction(posix_spawnp)(pid, file, fileActions, attrp, argv, envp);
+}
+
+PRELOAD_EXPORT int system(const char *cmd) {
+    enum preloadCommand_t command;
+    unsigned long window;
+    char file[64];
+    int status;
+    if (cmd != NULL && parseShellCommand(cmd, &command, &window)) {
+        shellCommandProgram(cmd, file);
+        if (sendRequest(command, window, file, &status)) {
+            return W_EXITCODE(status, 0);
+        }
+    }
+    return realFunction(system)(cmd);
+}
+
+// The exec functions are only intercepted in forked children, which exit
+// with the status of the request instead of executing the command
+bool execIntercepted(const char *file, char *const argv[]) {
+    enum preloadCommand_t command;
+    unsigned long window;
+    int status;
+    if (getpid() != preloadData.ownerPid && parseCommand(argv, &command, &window) &&
+            sendRequest(command, window, file, &status)) {
+        _exit(status);
+    }
+    return false;
+}
+
+PRELOAD_EXPORT int execve(const char *path, char *const argv[], char *const envp[]) {
+    execIntercepted(path, argv);
+    return realFunction(execve)(path, argv, envp);
+}
+
+PRELOAD_EXPORT int execv(const char *path, char *const argv[]) {
+    execIntercepted(path, argv);
+    return realFunction(execv)(path, argv);
+}
+
+PRELOAD_EXPORT int execvp(const char *file, char *const argv[]) {
+    execIntercepted(file, argv);
+    return realFunction(execvp)(file, argv);
+}
+
+PRELOAD_EXPORT int execvpe(const char *file, char *const argv[], char *const envp[]) {
+    execIntercepted(file, argv);
+    return realFunction(execvpe)(file, argv, envp);
+}
@@ -0,0 +1,610 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "xdgss.h"
+#include "xdgss-scan.h"
+#include "xdgss-trace.h"
+
+const size_t NULL_BYTE_LEN = 1;
+
+#define cleanReturn(value) do { returnValue = value; goto cleanReturn; } while (false)
+
+bool allocSprintf(char **returnStr, const char *format, ...) {
+    va_list ap;
+    bool returnValue = true;
+    char *str = NULL;
+    va_start(ap, format);
+    int strLen = vsnprintf(NULL, 0, format, ap);
+    va_end(ap);
+    if (strLen < 0) {
+        fprintf(stderr, "Unexpected vsnprintf error encountered\n");
+        cleanReturn(false);
+    }
+    size_t size = (size_t)strLen + NULL_BYTE_LEN;
+    if ((str = malloc(size)) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+    va_start(ap, format);
+    int strLen2 = vsnprintf(str, size, format, ap);
+    va_end(ap);
+    if (strLen != strLen2) {
+        fprintf(stderr, "Unexpected vsnprintf error encountered\n");
+        cleanReturn(false);
+    }
+cleanReturn:
+    if (!returnValue) {
+        free(str);
+        str = NULL;
+    }
+    *returnStr = str;
+    return returnValue;
+}
+
+// Buffer for command lines that is reused for all processes of a scan
+struct cmdlineBuffer_t {
+    char *data;
+    size_t size;
+};
+
+// Checks of checkAndResumeProcess that a process passed (for probes)
+enum scanStage_t {
+    SCAN_STAGE_EXE = 1,
+    SCAN_STAGE_CMDLINE,
+    SCAN_STAGE_SUSPEND,
+    SCAN_STAGE_WINDOW
+};
+
+// Cut " (deleted)" from the end of the exe link of a process, returns the new
+// length
+size_t stripDeletedSuffix(char *exeLink, size_t exeLinkLen) {
+    static const char suffix[] = " (deleted)";
+    const size_t suffixLen = sizeof(suffix) - NULL_BYTE_LEN;
+    if (exeLinkLen >= suffixLen &&
+            memcmp(&exeLink[exeLinkLen - suffixLen], suffix, suffixLen) == 0) {
+        exeLinkLen -= suffixLen;
+        exeLink[exeLinkLen] = '\0';
+    }
+    return exeLinkLen;
+}
+
+// Check if the argument at arg is a string literal, the null byte is compared
+// as well, so the length of the argument doesn't have to be known
+#define argIs(arg, cmdlineEnd, literal) \
+    ((size_t)((cmdlineEnd) - (arg)) >= sizeof(literal) && \
+     memcmp(arg, literal, sizeof(literal)) == 0)
+
+const char *parseCmdlineWindow(const char *arg, unsigned long *returnWindow) {
+    char *windowEnd;
+    if (arg[0] == '\0') {
+        return NULL;
+    }
+    *returnWindow = strtoul(arg, &windowEnd, 0);
+    return windowEnd[0] == '\0' ? windowEnd : NULL;
+}
+
+enum cmdlineMatch_t matchSuspendCmdline(const char *cmdline, size_t cmdlineSize,
+                                        unsigned long window, size_t *returnWindowsLen) {
+    const char *cmdlineEnd = &cmdline[cmdlineSize];
+    // check argc >= 1 and argv[1] is "suspend"
+    const char *arg = (const char *)memchr(cmdline, '\0', cmdlineSize) + NULL_BYTE_LEN;
+    if (!argIs(arg, cmdlineEnd, "suspend")) {
+        return argIs(arg, cmdlineEnd, "zygote") ? CMDLINE_MATCH_ZYGOTE : CMDLINE_MATCH_NONE;
+    }
+    // check argc >= 2 and the remaining arguments are windows (after options)
+    arg += sizeof("suspend");
+    while (true) {
+        if (argIs(arg, cmdlineEnd, "--watch-owner")) {
+            arg += sizeof("--watch-owner");
+        } else if (argIs(arg, cmdlineEnd, "--fast-teardown")) {
+            arg += sizeof("--fast-teardown");
+        } else {
+            break;
+        }
+    }
+    size_t windowsLen = 0;
+    bool windowFound = false;
+    // Each window ends where strtoul stops, the arguments are not scanned twice
+    const char *windowEnd;
+    for (; arg < cmdlineEnd; arg = windowEnd + NULL_BYTE_LEN) {
+        unsigned long cmdlineWindow;
+        if ((windowEnd = parseCmdlineWindow(arg, &cmdlineWindow)) == NULL) {
+            return CMDLINE_MATCH_SUSPEND;
+        }
+        windowsLen++;
+        windowFound = windowFound || cmdlineWindow == window;
+    }
+    *returnWindowsLen = windowsLen;
+    return windowFound ? CMDLINE_MATCH_WINDOW : CMDLINE_MATCH_SUSPEND;
+}
+
+// Kill process pid if it runs "selfExeLink suspend window" (doesn't allocate
+// unless the command line doesn't fit into cmdlineBuf)
+bool checkAndResumeProcess(int pid, const char *selfExeLink, unsigned long window,
+                           struct cmdlineBuffer_t *cmdlineBuf, struct scanStats_t *stats) {
+    bool returnValue = true;
+    char procPath[sizeof("/proc//cmdline") + 3 * sizeof(int)];
+    char exeLink[PATH_MAX];
+    int cmdlineFd = -1;
+    // Check if process is same exe
+    snprintf(procPath, sizeof(procPath), "/proc/%d/exe", pid);
+    ssize_t exeLinkLen = readlink(procPath, exeLink, sizeof(exeLink));
+    stats->syscalls++;
+    if (exeLinkLen < 0) {
+        if (errno == EACCES || errno == ENOENT) {
+            if (errno == EACCES) {
+                stats->eacces++;
+            } else {
+                stats->enoent++;
+            }
+            cleanReturn(true);
+        }
+        fprintf(stderr, "Failed to read link %s: %s\n", procPath, strerror(errno));
+        cleanReturn(false);
+    }
+    if (exeLinkLen == sizeof(exeLink)) {
+        cleanReturn(true); // truncated, can't be the resolved selfExeLink
+    }
+    exeLink[exeLinkLen] = '\0';
+    stripDeletedSuffix(exeLink, (size_t)exeLinkLen);
+    if (strcmp(exeLink, selfExeLink) != 0) {
+        cleanReturn(true);
+    }
+    stats->exeMatches++;
+    PROBE2(scan_stage, pid, SCAN_STAGE_EXE);
+    // Check command line arguments of process
+    snprintf(procPath, sizeof(procPath), "/proc/%d/cmdline", pid);
+    cmdlineFd = open(procPath, O_RDONLY | O_CLOEXEC);
+    stats->syscalls++;
+    if (cmdlineFd < 0) {
+        if (errno == EACCES || errno == ENOENT) {
+            if (errno == EACCES) {
+                stats->eacces++;
+            } else {
+                stats->enoent++;
+            }
+            cleanReturn(true);
+        }
+        fprintf(stderr, "Failed to open %s: %s\n", procPath, strerror(errno));
+        cleanReturn(false);
+    }
+    ssize_t cmdlineSize = 0;
+    while (true) {
+        if (cmdlineSize == cmdlineBuf->size) {
+            size_t size = cmdlineBuf->size > 0 ? cmdlineBuf->size * 2 : 1024;
+            char *data;
+            if ((data = realloc(cmdlineBuf->data, size)) == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                cleanReturn(false);
+            }
+            cmdlineBuf->data = data;
+            cmdlineBuf->size = size;
+        }
+        ssize_t cmdlinePartSize = read(cmdlineFd, &cmdlineBuf->data[cmdlineSize],
+                                       cmdlineBuf->size - (size_t)cmdlineSize);
+        stats->syscalls++;
+        if (cmdlinePartSize < 0 && errno == ESRCH) {
+            // Exited after the cmdline was opened
+            stats->enoent++;
+            cleanReturn(true);
+        }
+        if (cmdlinePartSize < 0) {
+            fprintf(stderr, "Failed to read cmdline: %s\n", strerror(errno));
+            cleanReturn(false);
+        }
+        if (cmdlinePartSize == 0) {
+            break;
+        }
+        cmdlineSize += cmdlinePartSize;
+        stats->cmdlineBytes += (unsigned long)cmdlinePartSize;
+    }
+    char *cmdline = cmdlineBuf->data;
+    // Exited after the exe was read (its memory is gone, zombies are left)
+    if (cmdlineSize == 0) {
+        stats->enoent++;
+        cleanReturn(true);
+    }
+    if (cmdline[cmdlineSize-1] != '\0') {
+        fprintf(stderr, "Invalid cmdline encountered\n");
+        cleanReturn(false);
+    }
+    stats->cmdlinesRead++;
+    PROBE2(scan_stage, pid, SCAN_STAGE_CMDLINE);
+    size_t windowsLen = 0;
+    enum cmdlineMatch_t match = matchSuspendCmdline(cmdline, (size_t)cmdlineSize, window,
+                                                    &windowsLen);
+    if (match == CMDLINE_MATCH_NONE) {
+        cleanReturn(true);
+    }
+    if (match == CMDLINE_MATCH_ZYGOTE) {
+        // The window of a child is not visible from outside
+        stats->zygoteMatches++;
+    } else {
+        stats->suspendMatches++;
+        PROBE2(scan_stage, pid, SCAN_STAGE_SUSPEND);
+        if (match != CMDLINE_MATCH_WINDOW) {
+            cleanReturn(true);
+        }
+        stats->windowMatches++;
+        PROBE2(scan_stage, pid, SCAN_STAGE_WINDOW);
+    }
+    // Send SIGTERM to process or ask it to stop waiting for one of its windows
+    int signo = match == CMDLINE_MATCH_WINDOW && windowsLen == 1 ? SIGTERM
+                                                                 : XDGSS_RELEASE_WINDOW_SIGNAL;
+    xdgssTrace("kill", "\"target\":%d,\"signal\":%d", pid, signo);
+    if ((signo == SIGTERM ? kill(pid, SIGTERM)
+                          : sigqueue(pid, XDGSS_RELEASE_WINDOW_SIGNAL,
+                                     (union sigval){.sival_ptr = (void *)window})) < 0) {
+        stats->syscalls++;
+        if (errno == EPERM || errno == ESRCH) {
+            cleanReturn(true);
+        }
+        fprintf(stderr, "Failed to kill process %d: %s\n", pid, strerror(errno));
+        cleanReturn(false);
+    }
+    stats->syscalls++;
+    if (match == CMDLINE_MATCH_WINDOW) {
+        stats->signalled++;
+    }
+    PROBE2(kill, pid, signo);
+cleanReturn:
+    if (cmdlineFd != -1) {
+        close(cmdlineFd);
+        stats->syscalls++;
+    }
+    return returnValue;
+}
+
+bool allocSelfCgroupPath(char **returnPath) {
+    bool returnValue = true;
+    char line[PATH_MAX];
+    char *path = NULL;
+    FILE *cgroupFile;
+    if ((cgroupFile = fopen("/proc/self/cgroup", "re")) == NULL) {
+        cleanReturn(true);
+    }
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), cgroupFile) != NULL) {
+        found = strncmp(line, "0::/", 4) == 0;
+    }
+    if (!found) {
+        cleanReturn(true);
+    }
+    line[strcspn(line, "\n")] = '\0';
+    // Hybrid setups mount the unified hierarchy separately
+    const char *mountPoint = access("/sys/fs/cgroup/cgroup.controllers", F_OK) == 0 ?
+                             "/sys/fs/cgroup" : "/sys/fs/cgroup/unified";
+    if (!allocSprintf(&path, "%s%s", mountPoint, &line[3])) {
+        cleanReturn(false);
+    }
+cleanReturn:
+    if (cgroupFile != NULL) {
+        fclose(cgroupFile);
+    }
+    *returnPath = path;
+    return returnValue;
+}
+
+bool isUserServiceCgroup(const char *path) {
+    char userService[sizeof("/user@.service") + 3 * sizeof(uid_t)];
+    int userServiceLen = snprintf(userService, sizeof(userService), "/user@%u.service",
+                                  (unsigned int)getuid());
+    const char *match = strstr(path, userService);
+    return match != NULL && (match[userServiceLen] == '\0' || match[userServiceLen] == '/');
+}
+
+// Path of name in $XDG_RUNTIME_DIR/xdg-screensaver-shim (returnPath is NULL if
+// XDG_RUNTIME_DIR is not set)
+bool allocRuntimePath(char **returnPath, const char *name) {
+    const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
+    if (runtimeDir == NULL || runtimeDir[0] == '\0') {
+        *returnPath = NULL;
+        return true;
+    }
+    return allocSprintf(returnPath, "%s/xdg-screensaver-shim/%s", runtimeDir, name);
+}
+
+bool allocScanCgroupPath(char **returnPath) {
+    bool returnValue = true;
+    char *recordPath = NULL, *path = NULL;
+    char buf[PATH_MAX];
+    int fd = -1;
+    if (!allocRuntimePath(&recordPath, "scope")) {
+        cleanReturn(false);
+    }
+    if (recordPath == NULL || (fd = open(recordPath, O_RDONLY | O_CLOEXEC)) < 0) {
+        cleanReturn(true);
+    }
+    // Written with one rename, never partially
+    ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    if (len <= 0 || buf[0] != '/') {
+        cleanReturn(true);
+    }
+    buf[len] = '\0';
+    if ((path = strdup(buf)) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+cleanReturn:
+    if (fd != -1) {
+        close(fd);
+    }
+    free(recordPath);
+    *returnPath = path;
+    return returnValue;
+}
+
+bool recordScanCgroup() {
+    bool returnValue = true;
+    char *path = NULL, *recordedPath = NULL, *recordPath = NULL, *tmpPath = NULL;
+    int fd = -1;
+    if (!allocSelfCgroupPath(&path) || path == NULL ||
+            !allocScanCgroupPath(&recordedPath) ||
+            !allocRuntimePath(&recordPath, "scope") || recordPath == NULL) {
+        cleanReturn(false);
+    }
+    // Recorded by an earlier member
+    if (recordedPath != NULL && strcmp(path, recordedPath) == 0) {
+        cleanReturn(true);
+    }
+    if (!allocSprintf(&tmpPath, "%s.%d", recordPath, getpid())) {
+        cleanReturn(false);
+    }
+    char *dirPathSep = strrchr(recordPath, '/');
+    *dirPathSep = '\0';
+    mkdir(recordPath, 0700);
+    *dirPathSep = '/';
+    size_t pathLen = strlen(path);
+    if ((fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) < 0 ||
+            write(fd, path, pathLen) != (ssize_t)pathLen ||
+            rename(tmpPath, recordPath) < 0) {
+        fprintf(stderr, "Failed to record %s: %s\n", recordPath, strerror(errno));
+        unlink(tmpPath);
+        cleanReturn(false);
+    }
+cleanReturn:
+    if (fd != -1) {
+        close(fd);
+    }
+    free(tmpPath);
+    free(recordPath);
+    free(recordedPath);
+    free(path);
+    return returnValue;
+}
+
+bool allocUnscopedPath(int pid, char **returnPath) {
+    char name[sizeof("unscoped/") + 3 * sizeof(int)];
+    snprintf(name, sizeof(name), "unscoped/%d", pid);
+    return allocRuntimePath(returnPath, name);
+}
+
+bool markUnscoped(int pid, bool unscoped) {
+    bool returnValue = true;
+    char *path = NULL;
+    int fd = -1;
+    if (!allocUnscopedPath(pid, &path) || path == NULL) {
+        cleanReturn(false);
+    }
+    if (!unscoped) {
+        cleanReturn(unlink(path) == 0 || errno == ENOENT);
+    }
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0600)) < 0 && errno == ENOENT) {
+        // Create the parent directories first
+        char *dirPathSep = strrchr(path, '/');
+        *dirPathSep = '\0';
+        char *parentDirPathSep = strrchr(path, '/');
+        *parentDirPathSep = '\0';
+        mkdir(path, 0700);
+        *parentDirPathSep = '/';
+        mkdir(path, 0700);
+        *dirPathSep = '/';
+        fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+    }
+    if (fd < 0) {
+        fprintf(stderr, "Failed to create %s: %s\n", path, strerror(errno));
+        cleanReturn(false);
+    }
+cleanReturn:
+    if (fd != -1) {
+        close(fd);
+    }
+    free(path);
+    return returnValue;
+}
+
+// Read the PIDs of the processes registered as unscoped into returnPids (must
+// be freed), markers of processes that are gone are removed
+bool allocUnscopedPids(int **returnPids, size_t *returnPidsLen) {
+    bool returnValue = true;
+    char *dirPath = NULL;
+    DIR *dir = NULL;
+    int *pids = NULL;
+    size_t pidsLen = 0, pidsSize = 0;
+    if (!allocRuntimePath(&dirPath, "unscoped") || dirPath == NULL) {
+        cleanReturn(false);
+    }
+    if ((dir = opendir(dirPath)) == NULL) {
+        // Nothing was registered yet
+        cleanReturn(errno == ENOENT);
+    }
+    struct dirent *dirEnt;
+    while ((dirEnt = readdir(dir)) != NULL) {
+        if (!isdigit(dirEnt->d_name[0])) {
+            continue;
+        }
+        int pid = atoi(dirEnt->d_name);
+        if (kill(pid, 0) < 0 && errno == ESRCH) {
+            unlinkat(dirfd(dir), dirEnt->d_name, 0);
+            continue;
+        }
+        if (pidsLen == pidsSize) {
+            size_t size = pidsSize > 0 ? pidsSize * 2 : 16;
+            int *newPids;
+            if ((newPids = realloc(pids, size * sizeof(int))) == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                cleanReturn(false);
+            }
+            pids = newPids;
+            pidsSize = size;
+        }
+        pids[pidsLen++] = pid;
+    }
+cleanReturn:
+    if (dir != NULL) {
+        closedir(dir);
+    }
+    free(dirPath);
+    if (!returnValue) {
+        free(pids);
+        pids = NULL;
+        pidsLen = 0;
+    }
+    *returnPids = pids;
+    *returnPidsLen = pidsLen;
+    return returnValue;
+}
+
+// Check the members of the recorded cgroup and the processes registered as
+// unscoped, returnScanned is set if that covers all inhibiting processes (if
+// not, /proc must be scanned)
+bool scanScope(const char *exeLink, unsigned long window, struct cmdlineBuffer_t *cmdlineBuf,
+               struct scanStats_t *stats, bool *returnScanned) {
+    bool returnValue = true, scanned = false;
+    char *cgroupPath = NULL, *procsPath = NULL;
+    FILE *procsFile = NULL;
+    int *unscopedPids = NULL;
+    size_t unscopedPidsLen = 0;
+    // Nothing is known without the record (e.g. without systemd), processes
+    // that inhibit before the first one joined are not registered
+    if (!allocScanCgroupPath(&cgroupPath) || cgroupPath == NULL) {
+        cleanReturn(true);
+    }
+    if (!allocUnscopedPids(&unscopedPids, &unscopedPidsLen) ||
+            !allocSprintf(&procsPath, "%s/cgroup.procs", cgroupPath)) {
+        cleanReturn(true);
+    }
+    // The scope is removed with its last member, nothing inhibits in it then
+    if ((procsFile = fopen(procsPath, "re")) == NULL && errno != ENOENT) {
+        cleanReturn(true);
+    }
+    scanned = true;
+    for (size_t i = 0; i < unscopedPidsLen; i++) {
+        stats->unscoped++;
+        stats->pidsExamined++;
+        if (!checkAndResumeProcess(unscopedPids[i], exeLink, window, cmdlineBuf, stats)) {
+            returnValue = false;
+            fprintf(stderr, "Continuing\n");
+        }
+    }
+    int pid;
+    while (procsFile != NULL && fscanf(procsFile, "%d", &pid) == 1) {
+        stats->cgroupMembers++;
+        // Registered while joining
+        bool examined = false;
+        for (size_t i = 0; !examined && i < unscopedPidsLen; i++) {
+            examined = unscopedPids[i] == pid;
+        }
+        if (examined) {
+            continue;
+        }
+        stats->pidsExamined++;
+        if (!checkAndResumeProcess(pid, exeLink, window, cmdlineBuf, stats)) {
+            returnValue = false;
+            fprintf(stderr, "Continuing\n");
+        }
+    }
+cleanReturn:
+    if (procsFile != NULL) {
+        fclose(procsFile);
+    }
+    free(unscopedPids);
+    free(procsPath);
+    free(cgroupPath);
+    *returnScanned = scanned;
+    return returnValue;
+}
+
+bool resumeProcesses(const char *exe, bool ignoreMissingExe, unsigned long window,
+                     struct scanStats_t *returnStats) {
+    bool returnValue = true;
+    char *exeLink = NULL;
+    DIR *procDir = NULL;
+    struct cmdlineBuffer_t cmdlineBuf = {0};
+    struct scanStats_t stats = {0};
+    xdgssTrace("scan_begin", "\"window\":%lu", window);
+    // Resolve symlinks to compare with the exe links of processes
+    if ((exeLink = realpath(exe, NULL)) == NULL) {
+        if (ignoreMissingExe && errno == ENOENT) {
+            cleanReturn(true);
+        }
+        fprintf(stderr, "Failed to resolve %s: %s\n", exe, strerror(errno));
+        cleanReturn(false);
+    }
+    bool scanned;
+    if (!scanScope(exeLink, window, &cmdlineBuf, &stats, &scanned)) {
+        returnValue = false;
+    }
+    if (scanned) {
+        cleanReturn(returnValue);
+    }
+    // Search processes in /proc
+    if ((procDir = opendir("/proc")) == NULL) {
+        fprintf(stderr, "Failed to open /proc: %s\n", strerror(errno));
+        cleanReturn(false);
+    }
+    struct dirent *procDirEnt;
+    while ((procDirEnt = readdir(procDir)) != NULL) {
+        stats.procEntries++;
+        if (!isdigit(procDirEnt->d_name[0])) {
+            continue;
+        }
+        int pid = atoi(procDirEnt->d_name);
+        stats.pidsExamined++;
+        if (!checkAndResumeProcess(pid, exeLink, window, &cmdlineBuf, &stats)) {
+            returnValue = false;
+            fprintf(stderr, "Continuing\n");
+        }
+    }
+cleanReturn:
+    if (procDir != NULL) {
+        closedir(procDir);
+    }
+    xdgssTrace("scan_end", "\"ok\":%s,\"pids_examined\":%lu,\"exe_matches\":%lu,"
+               "\"signalled\":%lu", TRACE_BOOL(returnValue), stats.pidsExamined,
+               stats.exeMatches, stats.signalled);
+    free(cmdlineBuf.data);
+    free(exeLink);
+    if (returnStats != NULL) {
+        *returnStats = stats;
+    }
+    return returnValue;
+}
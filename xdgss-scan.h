@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Helpers of libxdgss that don't require D-Bus or X, also built into
+// xdg-screensaver so that resume doesn't have to load libxdgss
+
+#ifndef XDGSS_SCAN_H
+#define XDGSS_SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+extern const size_t NULL_BYTE_LEN;
+
+bool allocSprintf(char **returnStr, const char *format, ...);
+
+// Parsing steps of a scan, exposed to be exercised without /proc
+
+// Cut " (deleted)" from the end of the exe link of a process, returns the new
+// length
+size_t stripDeletedSuffix(char *exeLink, size_t exeLinkLen);
+
+// Parse a window argument like strtoul with base 0, returns the end of the
+// argument (its null byte) or NULL if it's not a window
+const char *parseCmdlineWindow(const char *arg, unsigned long *returnWindow);
+
+enum cmdlineMatch_t {
+    // argv[1] is not "suspend"
+    CMDLINE_MATCH_NONE,
+    // "suspend" without window among the arguments
+    CMDLINE_MATCH_SUSPEND,
+    // "suspend" with window, returnWindowsLen is set
+    CMDLINE_MATCH_WINDOW,
+    // "zygote", the server or one of its children (which all have the same
+    // command line)
+    CMDLINE_MATCH_ZYGOTE
+};
+
+// Match the contents of /proc/PID/cmdline (cmdlineSize includes the final
+// null byte) against "EXE suspend [OPTIONS] WINDOW..." and "EXE zygote ..."
+enum cmdlineMatch_t matchSuspendCmdline(const char *cmdline, size_t cmdlineSize,
+                                        unsigned long window, size_t *returnWindowsLen);
+
+// Counters of a scan
+struct scanStats_t {
+    unsigned long procEntries, cgroupMembers, unscoped, pidsExamined;
+    // Processes that passed each check
+    unsigned long exeMatches, cmdlinesRead, suspendMatches, windowMatches, zygoteMatches;
+    // Processes skipped because of errors (gone or not accessible)
+    unsigned long eacces, enoent;
+    unsigned long cmdlineBytes;
+    // readlink, open, read, close and kill (readdir is not counted)
+    unsigned long syscalls;
+    // Processes of suspend that were signalled (zygotes are not counted)
+    unsigned long signalled;
+};
+
+// Path of the cgroup of the calling process in the unified hierarchy
+// (returnPath is NULL if there is none)
+bool allocSelfCgroupPath(char **returnPath);
+
+// Check if the cgroup at path is in the subtree of the user's service manager
+// (which can only move processes within its subtree)
+bool isUserServiceCgroup(const char *path);
+
+// Inhibiting processes join a transient scope of the user's service manager
+// (xdgss_join_scope) so that resume only has to check its members, those that
+// can't join register as unscoped in $XDG_RUNTIME_DIR/xdg-screensaver-shim
+
+// cgroup of the scope recorded by its members (returnPath is NULL if none was
+// recorded, resume has to scan /proc then)
+bool allocScanCgroupPath(char **returnPath);
+
+// Record the cgroup of the calling process as the cgroup of the scope
+bool recordScanCgroup();
+
+// Path of the registration of process pid as unscoped (returnPath is NULL if
+// XDG_RUNTIME_DIR is not set)
+bool allocUnscopedPath(int pid, char **returnPath);
+
+// Register process pid as inhibiting outside of the scope or remove the
+// registration
+bool markUnscoped(int pid, bool unscoped);
+
+// Kill all processes that run "exe suspend window" (or ask them to release
+// window if they wait for several windows), processes of "exe zygote" are
+// asked to release window as well (only children that inhibit for it
+// react), returnStats may be NULL
+bool resumeProcesses(const char *exe, bool ignoreMissingExe, unsigned long window,
+                     struct scanStats_t *returnStats);
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include "xdgss-trace.h"
+
+struct xdgssTraceData_t {
+    bool initialized;
+    int fd; // -1 if tracing is disabled
+} xdgssTraceData = {.fd = -1};
+
+void initTrace() {
+    struct xdgssTraceData_t *d = &xdgssTraceData;
+    d->initialized = true;
+    const char *target = getenv("XDGSS_TRACE");
+    if (target == NULL || target[0] == '\0') {
+        return;
+    }
+    char *targetEnd;
+    long fd = strtol(target, &targetEnd, 10);
+    if (targetEnd[0] == '\0' && fd >= 0 && fd <= INT32_MAX) {
+        d->fd = (int)fd;
+    } else if ((d->fd = open(target, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600)) < 0) {
+        fprintf(stderr, "Failed to open trace file %s: %s\n", target, strerror(errno));
+        d->fd = -1;
+    }
+}
+
+void xdgssTrace(const char *event, const char *fieldsFormat, ...) {
+    struct xdgssTraceData_t *d = &xdgssTraceData;
+    if (!d->initialized) {
+        initTrace();
+    }
+    if (d->fd == -1) {
+        return;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    // Formatted on the stack and written at once, so that lines of processes
+    // that share the file don't interleave
+    char line[512];
+    const size_t suffixSize = sizeof("}\n") - 1;
+    const size_t lineSize = sizeof(line) - suffixSize;
+    int len = snprintf(line, lineSize, "{\"ts_ns\":%" PRIu64 ",\"pid\":%d,\"event\":\"%s\"",
+                       (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec,
+                       getpid(), event);
+    if (fieldsFormat != NULL && len >= 0 && (size_t)len + 1 < lineSize) {
+        line[len++] = ',';
+        va_list ap;
+        va_start(ap, fieldsFormat);
+        int fieldsLen = vsnprintf(&line[len], lineSize - (size_t)len, fieldsFormat, ap);
+        va_end(ap);
+        len = fieldsLen < 0 ? -1 : len + fieldsLen;
+    }
+    if (len < 0) {
+        return;
+    }
+    if ((size_t)len >= lineSize) {
+        len = (int)lineSize - 1; // truncated
+    }
+    memcpy(&line[len], "}\n", suffixSize);
+    // Tracing must not change the behavior, errors are ignored
+    ssize_t written = write(d->fd, line, (size_t)len + suffixSize);
+    (void)written;
+}
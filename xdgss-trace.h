@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Opt-in tracing for measuring the phases of suspend and resume
+//
+// USDT probes (provider "xdgss") are compiled in if sys/sdt.h is available and
+// cost a nop when no tracer is attached, e.g.
+// bpftrace -e 'usdt:/usr/bin/xdg-screensaver:xdgss:kill { printf("%d\n", arg0); }'
+//
+// If XDGSS_TRACE is set to a file path (or to the number of an open fd), each
+// trace point appends one JSON line like
+// {"ts_ns":123,"pid":42,"event":"inhibit_end","backend":"portal","ok":true}
+// with a CLOCK_MONOTONIC timestamp. Otherwise trace points only check a flag.
+
+#ifndef XDGSS_TRACE_H
+#define XDGSS_TRACE_H
+
+#include <stdbool.h>
+#include "project-config.h"
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif
+
+// Append a trace line for event, fieldsFormat formats additional JSON
+// members (without braces) and may be NULL
+void xdgssTrace(const char *event, const char *fieldsFormat, ...)
+    __attribute__((format(printf, 2, 3)));
+
+#define TRACE_BOOL(value) ((value) ? "true" : "false")
+
+#ifdef HAVE_SYS_SDT_H
+#define PROBE0(name) DTRACE_PROBE(xdgss, name)
+#define PROBE1(name, a) DTRACE_PROBE1(xdgss, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(xdgss, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(xdgss, name, a, b, c)
+#else
+#define PROBE0(name) do {} while (false)
+#define PROBE1(name, a) do {} while (false)
+#define PROBE2(name, a, b) do {} while (false)
+#define PROBE3(name, a, b, c) do {} while (false)
+#endif
+
+#endif
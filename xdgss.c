@@ -0,0 +1,1542 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <dbus/dbus.h>
+#include "project-config.h"
+#ifdef HAVE_X11
+#include <X11/Xlib.h>
+#include <X11/Xlibint.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/scrnsaver.h>
+#ifdef HAVE_XRES
+#include <X11/extensions/XRes.h>
+#endif
+#else
+typedef unsigned long Window;
+#define None 0L
+#endif
+#include "xdgss.h"
+#include "xdgss-scan.h"
+#include "xdgss-trace.h"
+
+#define cleanReturn(value) do { returnValue = value; goto cleanReturn; } while (false)
+
+enum inhibitBackend_t {
+    INHIBIT_BACKEND_NONE,
+    INHIBIT_BACKEND_SCREENSAVER,  // org.freedesktop.ScreenSaver
+    INHIBIT_BACKEND_PORTAL,       // org.freedesktop.portal.Inhibit
+    INHIBIT_BACKEND_XSCREENSAVER, // MIT-SCREEN-SAVER extension of the X server
+    INHIBIT_BACKEND_LOGIND,       // org.freedesktop.login1 idle inhibitor
+    INHIBIT_BACKENDS_LEN
+};
+
+// Names used in the probe cache, the order of the enum is the probe order
+// (logind comes last because X screen savers don't respect it)
+const char *const INHIBIT_BACKEND_NAMES[] = {
+    "none", "screensaver", "portal", "xscreensaver", "logind"};
+
+struct xdgss_handle;
+
+// A window or process that keeps the inhibition of its handle active
+struct xdgssWatch_t {
+    struct xdgss_handle *handle;
+    Window window; // None for processes
+    // pidfd of the process or of the window's owner if it's watched instead
+    // of X events
+    int pidFd;
+    bool watching;
+};
+
+struct xdgss_handle {
+    // First window (None if not bound to windows)
+    Window window;
+    bool active;
+    enum inhibitBackend_t backend;
+    dbus_uint32_t screenSaverInhibitCookie;
+    char *portalRequestPath;
+    // Prepared when inhibited, so that releasing doesn't have to allocate
+    DBusMessage *unInhibitMsg;
+    // Don't wait for the reply to unInhibitMsg, it's sent with unInhibitSend
+    // on unInhibitConn (NULL if not prepared)
+    bool noReply;
+    DBusConnection *unInhibitConn;
+    DBusPreallocatedSend *unInhibitSend;
+    int logindInhibitFd;
+    // Process that the inhibition is bound to (0 if none)
+    pid_t pid;
+    // The inhibition is released when the last watch is gone (if there are any)
+    struct xdgssWatch_t *watches;
+    size_t watchesLen, watchingLen;
+    struct xdgss_handle *next;
+};
+
+struct xdgssData_t {
+    // Contains the X connection and the pidfds of watched window owners
+    int epollFd;
+    DBusError dbusErr;
+    DBusConnection *sessionBusConn, *systemBusConn;
+#ifdef HAVE_X11
+    Display *display;
+    int (*prevXErrorHandler)(Display *, XErrorEvent *);
+    int (*prevXIOErrorHandler)(Display *);
+    bool xErrorsTrapped;
+    int xErrorCode;
+#endif
+    // Backend that worked for the last inhibition
+    enum inhibitBackend_t probedBackend;
+    // All handles that are not freed yet
+    struct xdgss_handle *handles;
+    xdgss_stats stats;
+} xdgssData = {.epollFd = -1};
+
+bool deactivateHandle(struct xdgss_handle *h);
+
+bool initEpoll() {
+    struct xdgssData_t *d = &xdgssData;
+    if (d->epollFd == -1 && (d->epollFd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        fprintf(stderr, "Failed to create epoll fd: %s\n", strerror(errno));
+        d->epollFd = -1;
+        return false;
+    }
+    return true;
+}
+
+#ifdef HAVE_X11
+// X Error Handler that records errors of the library's display while they are
+// trapped and ignores them otherwise (e.g. BadWindow for destroyed windows)
+int xdgssXErrorHandler(Display *display, XErrorEvent *ev) {
+    struct xdgssData_t *d = &xdgssData;
+    if (display != d->display) {
+        return d->prevXErrorHandler(display, ev);
+    }
+    if (d->xErrorsTrapped && d->xErrorCode == Success) {
+        d->xErrorCode = ev->error_code;
+    }
+    return 0;
+}
+
+// X IO Error Handler that releases all inhibitions before calling the previous
+// handler (usually exits)
+int xdgssXIOErrorHandler(Display *display) {
+    struct xdgssData_t *d = &xdgssData;
+    if (display == d->display) {
+        d->display = NULL; // don't use or free display structure
+        for (struct xdgss_handle *h = d->handles; h != NULL; h = h->next) {
+            if (h->active) {
+                deactivateHandle(h);
+            }
+        }
+    }
+    return d->prevXIOErrorHandler(display);
+}
+
+bool openDisplay() {
+    struct xdgssData_t *d = &xdgssData;
+    if (d->display != NULL) {
+        return true;
+    }
+    if (!initEpoll()) {
+        return false;
+    }
+    xdgssTrace("x_open_begin", NULL);
+    d->display = XOpenDisplay(NULL);
+    xdgssTrace("x_open_end", "\"ok\":%s", TRACE_BOOL(d->display != NULL));
+    if (d->display == NULL) {
+        fprintf(stderr, "Failed to open X display\n");
+        return false;
+    }
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+    if (epoll_ctl(d->epollFd, EPOLL_CTL_ADD, XConnectionNumber(d->display), &ev) < 0) {
+        fprintf(stderr, "Failed to watch X connection: %s\n", strerror(errno));
+        XCloseDisplay(d->display);
+        d->display = NULL;
+        return false;
+    }
+    // Set custom X error handlers
+    if ((d->prevXErrorHandler = XSetErrorHandler(xdgssXErrorHandler)) == NULL) {
+        d->prevXErrorHandler = _XDefaultError;
+    }
+    if ((d->prevXIOErrorHandler = XSetIOErrorHandler(xdgssXIOErrorHandler)) == NULL) {
+        d->prevXIOErrorHandler = _XDefaultIOError;
+    }
+    return true;
+}
+
+void closeDisplay() {
+    struct xdgssData_t *d = &xdgssData;
+    if (d->display == NULL) {
+        return;
+    }
+    epoll_ctl(d->epollFd, EPOLL_CTL_DEL, XConnectionNumber(d->display), NULL);
+    XCloseDisplay(d->display);
+    d->display = NULL;
+    // Restore X error handlers
+    XSetErrorHandler(d->prevXErrorHandler);
+    XSetIOErrorHandler(d->prevXIOErrorHandler);
+}
+
+void trapXErrors() {
+    struct xdgssData_t *d = &xdgssData;
+    d->xErrorsTrapped = true;
+    d->xErrorCode = Success;
+}
+
+// Flush requests and return the first error since trapXErrors
+int untrapXErrors() {
+    struct xdgssData_t *d = &xdgssData;
+    xdgssTrace("xsync_begin", NULL);
+    XSync(d->display, false);
+    xdgssTrace("xsync_end", "\"error\":%d", d->xErrorCode);
+    d->xErrorsTrapped = false;
+    return d->xErrorCode;
+}
+
+// Check if any handle receives X events of window
+bool windowEventsSelected(Window window) {
+    struct xdgssData_t *d = &xdgssData;
+    for (struct xdgss_handle *h = d->handles; h != NULL; h = h->next) {
+        for (size_t i = 0; i < h->watchesLen; i++) {
+            struct xdgssWatch_t *w = &h->watches[i];
+            if (w->watching && w->pidFd == -1 && w->window == window) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Select events on window, unless another handle already does
+bool watchWindow(Window window) {
+    struct xdgssData_t *d = &xdgssData;
+    if (windowEventsSelected(window)) {
+        return true;
+    }
+    // Monitor X events for destruction of window (BadWindow error if window invalid)
+    trapXErrors();
+    XSelectInput(d->display, window, StructureNotifyMask);
+    int errorCode = untrapXErrors();
+    if (errorCode != Success) {
+        char errorText[256];
+        XGetErrorText(d->display, errorCode, errorText, sizeof(errorText));
+        fprintf(stderr, "Failed to watch X window 0x%lx: %s\n", window, errorText);
+        return false;
+    }
+    return true;
+}
+
+// Deselect events on window, unless another handle still needs them
+void unwatchWindow(Window window) {
+    struct xdgssData_t *d = &xdgssData;
+    if (d->display == NULL || windowEventsSelected(window)) {
+        return;
+    }
+    // Fails silently if the window is already destroyed
+    XSelectInput(d->display, window, NoEventMask);
+    XFlush(d->display);
+}
+#else
+bool openDisplay() {
+    fprintf(stderr, "Built without X11 support\n");
+    return false;
+}
+
+void closeDisplay() {}
+
+bool watchWindow(Window window) {
+    return false;
+}
+
+void unwatchWindow(Window window) {}
+#endif
+
+// Check if the session bus can be located without connecting to it
+// (explicit address or the default socket in XDG_RUNTIME_DIR)
+bool findSessionBus(bool *returnFound) {
+    bool returnValue = true;
+    bool found = false;
+    char *busPath = NULL;
+    const char *address = getenv("DBUS_SESSION_BUS_ADDRESS");
+    if (address != NULL && address[0] != '\0') {
+        found = true;
+        cleanReturn(true);
+    }
+    const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
+    if (runtimeDir == NULL || runtimeDir[0] == '\0') {
+        cleanReturn(true);
+    }
+    if (!allocSprintf(&busPath, "%s/bus", runtimeDir)) {
+        cleanReturn(false);
+    }
+    found = access(busPath, F_OK) == 0;
+cleanReturn:
+    free(busPath);
+    *returnFound = found;
+    return returnValue;
+}
+
+// Get the connection to the bus (reconnects if the bus went away)
+DBusConnection *getDBusConnection(DBusBusType busType) {
+    struct xdgssData_t *d = &xdgssData;
+    DBusConnection **conn = (
+        busType == DBUS_BUS_SYSTEM ? &d->systemBusConn : &d->sessionBusConn);
+    if (*conn != NULL && !dbus_connection_get_is_connected(*conn)) {
+        dbus_connection_close(*conn);
+        dbus_connection_unref(*conn);
+        *conn = NULL;
+    }
+    if (*conn == NULL) {
+        // Private connection because the application may use the shared one
+        xdgssTrace("dbus_connect_begin", "\"bus\":\"%s\"",
+                   busType == DBUS_BUS_SYSTEM ? "system" : "session");
+        *conn = dbus_bus_get_private(busType, &d->dbusErr);
+        xdgssTrace("dbus_connect_end", "\"ok\":%s", TRACE_BOOL(*conn != NULL));
+        if (*conn == NULL) {
+            if (dbus_error_is_set(&d->dbusErr)) {
+                fprintf(stderr, "Failed to connect D-Bus: %s\n", d->dbusErr.message);
+            }
+            dbus_error_free(&d->dbusErr);
+            return NULL;
+        }
+        dbus_connection_set_exit_on_disconnect(*conn, false);
+    }
+    return *conn;
+}
+
+// Check if backend inhibits through the session bus
+bool usesSessionBus(enum inhibitBackend_t backend) {
+    return backend == INHIBIT_BACKEND_SCREENSAVER || backend == INHIBIT_BACKEND_PORTAL;
+}
+
+// Close the connection to the session bus if no active inhibition uses it
+// (opened for probing or by xdgss_join_scope)
+void closeUnusedSessionBus() {
+    struct xdgssData_t *d = &xdgssData;
+    if (d->sessionBusConn == NULL) {
+        return;
+    }
+    for (struct xdgss_handle *h = d->handles; h != NULL; h = h->next) {
+        if (h->active && usesSessionBus(h->backend)) {
+            return;
+        }
+    }
+    dbus_connection_close(d->sessionBusConn);
+    dbus_connection_unref(d->sessionBusConn);
+    d->sessionBusConn = NULL;
+}
+
+// Send msg without waiting for a reply, with the resources of preallocated
+// if it's for the current connection (freed in any case)
+bool sendDBusMessage(DBusBusType busType, DBusMessage *msg, DBusConnection *preallocatedConn,
+                     DBusPreallocatedSend *preallocated) {
+    DBusConnection *conn = getDBusConnection(busType);
+    if (preallocated != NULL && conn == preallocatedConn) {
+        dbus_connection_send_preallocated(conn, preallocated, msg, NULL);
+    } else {
+        if (preallocated != NULL) {
+            dbus_connection_free_preallocated_send(preallocatedConn, preallocated);
+        }
+        if (conn == NULL) {
+            return false;
+        }
+        if (!dbus_connection_send(conn, msg, NULL)) {
+            fprintf(stderr, "Out of memory\n");
+            return false;
+        }
+    }
+    dbus_connection_flush(conn);
+    return true;
+}
+
+// Call D-Bus method on the (reused) connection to bus and wait for the reply,
+// the reply is checked for errors only
+bool callDBusMethod(DBusBusType busType, DBusMessage *msg, DBusMessage **returnReplyMsg) {
+    bool returnValue = true;
+    struct xdgssData_t *d = &xdgssData;
+    DBusMessage *replyMsg = NULL;
+    DBusConnection *conn;
+    if ((conn = getDBusConnection(busType)) == NULL) {
+        cleanReturn(false);
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    replyMsg = dbus_connection_send_with_reply_and_block(
+        conn, msg, DBUS_TIMEOUT_USE_DEFAULT, &d->dbusErr);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    // Round trip in the log2 bucket of its microseconds
+    uint64_t rtt = ((uint64_t)(end.tv_sec - start.tv_sec) * 1000000000 +
+                    (uint64_t)end.tv_nsec - (uint64_t)start.tv_nsec) / 1000;
+    size_t bucket = 0;
+    while (rtt > 1 && bucket < XDGSS_RTT_BUCKETS - 1) {
+        rtt >>= 1;
+        bucket++;
+    }
+    d->stats.dbus_rtt[bucket]++;
+    if (replyMsg == NULL) {
+        if (dbus_error_is_set(&d->dbusErr)) {
+            fprintf(stderr, "Failed to call D-Bus method: %s\n", d->dbusErr.message);
+        }
+        cleanReturn(false);
+    }
+cleanReturn:
+    dbus_error_free(&d->dbusErr);
+    *returnReplyMsg = replyMsg;
+    return returnValue;
+}
+
+bool inhibitScreenSaver(struct xdgss_handle *h, const char *prog, const char *reason) {
+    bool returnValue = true;
+    DBusMessage *inhibitMsg = NULL, *inhibitReplyMsg = NULL;
+    if ((inhibitMsg = dbus_message_new_method_call(
+            "org.freedesktop.ScreenSaver",
+            "/org/freedesktop/ScreenSaver",
+            "org.freedesktop.ScreenSaver",
+            "Inhibit")) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+    DBusMessageIter inhibitMsgIter;
+    dbus_message_iter_init_append(inhibitMsg, &inhibitMsgIter);
+    if (!dbus_message_iter_append_basic(
+            &inhibitMsgIter, DBUS_TYPE_STRING, &prog) ||
+            !dbus_message_iter_append_basic(
+            &inhibitMsgIter, DBUS_TYPE_STRING, &reason)) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+    if (!callDBusMethod(DBUS_BUS_SESSION, inhibitMsg, &inhibitReplyMsg)) {
+        cleanReturn(false);
+    }
+    DBusMessageIter inhibitReplyMsgIter;
+    dbus_message_iter_init(inhibitReplyMsg, &inhibitReplyMsgIter);
+    if (dbus_message_iter_get_arg_type(&inhibitReplyMsgIter) != DBUS_TYPE_UINT32) {
+        fprintf(stderr, "Unexpected D-Bus reply\n");
+        cleanReturn(false);
+    }
+    dbus_message_iter_get_basic(&inhibitReplyMsgIter, &h->screenSaverInhibitCookie);
+    h->backend = INHIBIT_BACKEND_SCREENSAVER;
+    dbus_message_iter_next(&inhibitReplyMsgIter);
+    if (dbus_message_iter_get_arg_type(&inhibitReplyMsgIter) != DBUS_TYPE_INVALID) {
+        fprintf(stderr, "Unexpected D-Bus reply\n");
+        cleanReturn(false);
+    }
+cleanReturn:
+    if (inhibitReplyMsg != NULL) {
+        dbus_message_unref(inhibitReplyMsg);
+    }
+    if (inhibitMsg != NULL) {
+        dbus_message_unref(inhibitMsg);
+    }
+    return returnValue;
+}
+
+bool inhibitPortal(struct xdgss_handle *h, const char *reason) {
+    bool returnValue = true;
+    DBusMessage *inhibitMsg = NULL, *inhibitReplyMsg = NULL;
+    char *parentWindow = NULL;
+    const dbus_uint32_t flags = 8; // Idle
+    if ((inhibitMsg = dbus_message_new_method_call(
+            "org.freedesktop.portal.Desktop",
+            "/org/freedesktop/portal/desktop",
+            "org.freedesktop.portal.Inhibit",
+            "Inhibit")) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+    if (h->window == None) {
+        parentWindow = strdup("");
+    } else if (!allocSprintf(&parentWindow, "x11:%lx", h->window)) {
+        cleanReturn(false);
+    }
+    if (parentWindow == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+    DBusMessageIter inhibitMsgIter, optionsIter, reasonIter, reasonValueIter;
+    const char *reasonKey = "reason";
+    dbus_message_iter_init_append(inhibitMsg, &inhibitMsgIter);
+    if (!dbus_message_iter_append_basic(
+            &inhibitMsgIter, DBUS_TYPE_STRING, &parentWindow) ||
+            !dbus_message_iter_append_basic(
+            &inhibitMsgIter, DBUS_TYPE_UINT32, &flags) ||
+            !dbus_message_iter_open_container(
+            &inhibitMsgIter, DBUS_TYPE_ARRAY, "{sv}", &optionsIter) ||
+            !dbus_message_iter_open_container(
+            &optionsIter, DBUS_TYPE_DICT_ENTRY, NULL, &reasonIter) ||
+            !dbus_message_iter_append_basic(
+            &reasonIter, DBUS_TYPE_STRING, &reasonKey) ||
+            !dbus_message_iter_open_container(
+            &reasonIter, DBUS_TYPE_VARIANT, "s", &reasonValueIter) ||
+            !dbus_message_iter_append_basic(
+            &reasonValueIter, DBUS_TYPE_STRING, &reason) ||
+            !dbus_message_iter_close_container(&reasonIter, &reasonValueIter) ||
+            !dbus_message_iter_close_container(&optionsIter, &reasonIter) ||
+            !dbus_message_iter_close_container(&inhibitMsgIter, &optionsIter)) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+    if (!callDBusMethod(DBUS_BUS_SESSION, inhibitMsg, &inhibitReplyMsg)) {
+        cleanReturn(false);
+    }
+    DBusMessageIter inhibitReplyMsgIter;
+    dbus_message_iter_init(inhibitReplyMsg, &inhibitReplyMsgIter);
+    if (dbus_message_iter_get_arg_type(&inhibitReplyMsgIter) != DBUS_TYPE_OBJECT_PATH) {
+        fprintf(stderr, "Unexpected D-Bus reply\n");
+        cleanReturn(false);
+    }
+    const char *requestPath;
+    dbus_message_iter_get_basic(&inhibitReplyMsgIter, &requestPath);
+    if ((h->portalRequestPath = strdup(requestPath)) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+    h->backend = INHIBIT_BACKEND_PORTAL;
+    dbus_message_iter_next(&inhibitReplyMsgIter);
+    if (dbus_message_iter_get_arg_type(&inhibitReplyMsgIter) != DBUS_TYPE_INVALID) {
+        fprintf(stderr, "Unexpected D-Bus reply\n");
+        cleanReturn(false);
+    }
+cleanReturn:
+    if (inhibitReplyMsg != NULL) {
+        dbus_message_unref(inhibitReplyMsg);
+    }
+    if (inhibitMsg != NULL) {
+        dbus_message_unref(inhibitMsg);
+    }
+    free(parentWindow);
+    return returnValue;
+}
+
+bool inhibitLogind(struct xdgss_handle *h, const char *prog, const char *reason) {
+    bool returnValue = true;
+    DBusMessage *inhibitMsg = NULL, *inhibitReplyMsg = NULL;
+    const char *what = "idle", *mode = "block";
+    if ((inhibitMsg = dbus_message_new_method_call(
+            "org.freedesktop.login1",
+            "/org/freedesktop/login1",
+            "org.freedesktop.login1.Manager",
+            "Inhibit")) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+    DBusMessageIter inhibitMsgIter;
+    dbus_message_iter_init_append(inhibitMsg, &inhibitMsgIter);
+    if (!dbus_message_iter_append_basic(
+            &inhibitMsgIter, DBUS_TYPE_STRING, &what) ||
+            !dbus_message_iter_append_basic(
+            &inhibitMsgIter, DBUS_TYPE_STRING, &prog) ||
+            !dbus_message_iter_append_basic(
+            &inhibitMsgIter, DBUS_TYPE_STRING, &reason) ||
+            !dbus_message_iter_append_basic(
+            &inhibitMsgIter, DBUS_TYPE_STRING, &mode)) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+    if (!callDBusMethod(DBUS_BUS_SYSTEM, inhibitMsg, &inhibitReplyMsg)) {
+        cleanReturn(false);
+    }
+    DBusMessageIter inhibitReplyMsgIter;
+    dbus_message_iter_init(inhibitReplyMsg, &inhibitReplyMsgIter);
+    if (dbus_message_iter_get_arg_type(&inhibitReplyMsgIter) != DBUS_TYPE_UNIX_FD) {
+        fprintf(stderr, "Unexpected D-Bus reply\n");
+        cleanReturn(false);
+    }
+    dbus_message_iter_get_basic(&inhibitReplyMsgIter, &h->logindInhibitFd);
+    h->backend = INHIBIT_BACKEND_LOGIND;
+    dbus_message_iter_next(&inhibitReplyMsgIter);
+    if (dbus_message_iter_get_arg_type(&inhibitReplyMsgIter) != DBUS_TYPE_INVALID) {
+        fprintf(stderr, "Unexpected D-Bus reply\n");
+        cleanReturn(false);
+    }
+cleanReturn:
+    if (inhibitReplyMsg != NULL) {
+        dbus_message_unref(inhibitReplyMsg);
+    }
+    if (inhibitMsg != NULL) {
+        dbus_message_unref(inhibitMsg);
+    }
+    return returnValue;
+}
+
+bool inhibitXScreenSaver(struct xdgss_handle *h) {
+#ifdef HAVE_X11
+    struct xdgssData_t *d = &xdgssData;
+    int eventBase, errorBase, majorVersion, minorVersion;
+    if (!openDisplay()) {
+        return false;
+    }
+    // XScreenSaverSuspend requires version 1.1 of the extension
+    if (!XScreenSaverQueryExtension(d->display, &eventBase, &errorBase) ||
+            !XScreenSaverQueryVersion(d->display, &majorVersion, &minorVersion) ||
+            (majorVersion == 1 && minorVersion < 1) || majorVersion < 1) {
+        fprintf(stderr, "X server does not support MIT-SCREEN-SAVER 1.1\n");
+        return false;
+    }
+    // Suspensions are counted per X connection and end when it is closed
+    trapXErrors();
+    XScreenSaverSuspend(d->display, True);
+    if (untrapXErrors() != Success) {
+        fprintf(stderr, "Failed to suspend X screen saver\n");
+        return false;
+    }
+    h->backend = INHIBIT_BACKEND_XSCREENSAVER;
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Build the D-Bus message that releases the inhibition of h (if any)
+bool prepareUnInhibit(struct xdgss_handle *h) {
+    DBusMessage *msg = NULL;
+    if (h->unInhibitMsg != NULL) {
+        return true;
+    }
+    if (h->backend == INHIBIT_BACKEND_SCREENSAVER) {
+        if ((msg = dbus_message_new_method_call(
+                "org.freedesktop.ScreenSaver",
+                "/org/freedesktop/ScreenSaver",
+                "org.freedesktop.ScreenSaver",
+                "UnInhibit")) == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return false;
+        }
+        DBusMessageIter msgIter;
+        dbus_message_iter_init_append(msg, &msgIter);
+        if (!dbus_message_iter_append_basic(
+                &msgIter, DBUS_TYPE_UINT32, &h->screenSaverInhibitCookie)) {
+            fprintf(stderr, "Out of memory\n");
+            dbus_message_unref(msg);
+            return false;
+        }
+    } else if (h->backend == INHIBIT_BACKEND_PORTAL) {
+        if ((msg = dbus_message_new_method_call(
+                "org.freedesktop.portal.Desktop",
+                h->portalRequestPath,
+                "org.freedesktop.portal.Request",
+                "Close")) == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return false;
+        }
+    } else {
+        return true;
+    }
+    dbus_message_set_no_reply(msg, h->noReply);
+    h->unInhibitMsg = msg;
+    // Sending allocates queue entries, they are allocated now as well
+    DBusConnection *conn;
+    if (h->noReply && (conn = getDBusConnection(DBUS_BUS_SESSION)) != NULL &&
+            (h->unInhibitSend = dbus_connection_preallocate_send(conn)) != NULL) {
+        h->unInhibitConn = dbus_connection_ref(conn);
+    }
+    return true;
+}
+
+// Try to inhibit screen saver with backend, on failure the backend is left unused
+// unless it got inhibited and failed afterwards
+bool inhibitWithBackend(struct xdgss_handle *h, enum inhibitBackend_t backend) {
+    bool returnValue = true;
+    char *reason = NULL;
+    const char *prog = program_invocation_name;
+    if (h->watchesLen > 1 ? !allocSprintf(&reason, "waiting for %zu X windows", h->watchesLen)
+        : h->window != None ? !allocSprintf(&reason, "waiting for X window %#lx", h->window)
+        : h->pid != 0 ? !allocSprintf(&reason, "waiting for process %d", h->pid)
+                      : !allocSprintf(&reason, "requested by process %d", getpid())) {
+        cleanReturn(false);
+    }
+    bool sessionBusFound = false;
+    if (usesSessionBus(backend) && !findSessionBus(&sessionBusFound)) {
+        cleanReturn(false);
+    }
+    xdgssTrace("inhibit_begin", "\"backend\":\"%s\"", INHIBIT_BACKEND_NAMES[backend]);
+    PROBE1(inhibit_begin, backend);
+    switch (backend) {
+    case INHIBIT_BACKEND_SCREENSAVER:
+        returnValue = sessionBusFound && inhibitScreenSaver(h, prog, reason);
+        break;
+    case INHIBIT_BACKEND_PORTAL:
+        returnValue = sessionBusFound && inhibitPortal(h, reason);
+        break;
+    case INHIBIT_BACKEND_XSCREENSAVER:
+        returnValue = inhibitXScreenSaver(h);
+        break;
+    case INHIBIT_BACKEND_LOGIND:
+        returnValue = inhibitLogind(h, prog, reason);
+        break;
+    default:
+        returnValue = false;
+    }
+    xdgssTrace("inhibit_end", "\"backend\":\"%s\",\"ok\":%s,\"cookie\":%" PRIu32,
+               INHIBIT_BACKEND_NAMES[backend], TRACE_BOOL(returnValue),
+               (uint32_t)h->screenSaverInhibitCookie);
+    PROBE3(inhibit_end, backend, returnValue, h->screenSaverInhibitCookie);
+    // Failure is not fatal, the message is built again when releasing
+    if (returnValue) {
+        prepareUnInhibit(h);
+    }
+cleanReturn:
+    free(reason);
+    return returnValue;
+}
+
+bool unInhibitWithBackend(struct xdgss_handle *h) {
+    bool returnValue = true;
+    DBusMessage *unInhibitReplyMsg = NULL;
+    enum inhibitBackend_t backend = h->backend;
+    xdgssTrace("uninhibit_begin", "\"backend\":\"%s\"", INHIBIT_BACKEND_NAMES[backend]);
+    PROBE1(uninhibit_begin, backend);
+    if (h->backend == INHIBIT_BACKEND_XSCREENSAVER) {
+#ifdef HAVE_X11
+        // Nothing to do if the X connection is already lost
+        struct xdgssData_t *d = &xdgssData;
+        if (d->display != NULL) {
+            XScreenSaverSuspend(d->display, False);
+            XFlush(d->display);
+        }
+#endif
+        cleanReturn(true);
+    } else if (h->backend == INHIBIT_BACKEND_LOGIND) {
+        // logind releases the inhibitor when the last copy of its fd is closed
+        close(h->logindInhibitFd);
+        h->logindInhibitFd = -1;
+        cleanReturn(true);
+    } else if (h->backend == INHIBIT_BACKEND_NONE) {
+        cleanReturn(true);
+    }
+    // Usually prepared already
+    if (!prepareUnInhibit(h)) {
+        cleanReturn(false);
+    }
+    if (h->noReply) {
+        returnValue = sendDBusMessage(DBUS_BUS_SESSION, h->unInhibitMsg, h->unInhibitConn,
+                                      h->unInhibitSend);
+        h->unInhibitSend = NULL;
+        cleanReturn(returnValue);
+    }
+    if (!callDBusMethod(DBUS_BUS_SESSION, h->unInhibitMsg, &unInhibitReplyMsg)) {
+        cleanReturn(false);
+    }
+    DBusMessageIter unInhibitReplyMsgIter;
+    dbus_message_iter_init(unInhibitReplyMsg, &unInhibitReplyMsgIter);
+    if (dbus_message_iter_get_arg_type(&unInhibitReplyMsgIter) != DBUS_TYPE_INVALID) {
+        fprintf(stderr, "Unexpected D-Bus reply\n");
+        cleanReturn(false);
+    }
+cleanReturn:
+    if (unInhibitReplyMsg != NULL) {
+        dbus_message_unref(unInhibitReplyMsg);
+    }
+    if (h->unInhibitMsg != NULL) {
+        dbus_message_unref(h->unInhibitMsg);
+        h->unInhibitMsg = NULL;
+    }
+    if (h->unInhibitSend != NULL) {
+        dbus_connection_free_preallocated_send(h->unInhibitConn, h->unInhibitSend);
+        h->unInhibitSend = NULL;
+    }
+    if (h->unInhibitConn != NULL) {
+        dbus_connection_unref(h->unInhibitConn);
+        h->unInhibitConn = NULL;
+    }
+    free(h->portalRequestPath);
+    h->portalRequestPath = NULL;
+    h->backend = INHIBIT_BACKEND_NONE;
+    xdgssTrace("uninhibit_end", "\"backend\":\"%s\",\"ok\":%s",
+               INHIBIT_BACKEND_NAMES[backend], TRACE_BOOL(returnValue));
+    PROBE2(uninhibit_end, backend, returnValue);
+    return returnValue;
+}
+
+// Get path of the file that caches the probed backend for the current session
+// (NULL if there is no runtime directory)
+bool allocProbeCachePath(char **returnPath) {
+    bool returnValue = true;
+    char *path = NULL;
+    const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
+    if (runtimeDir == NULL || runtimeDir[0] == '\0') {
+        cleanReturn(true);
+    }
+    // Key the cache by session bus address and DISPLAY (FNV-1a)
+    const char *keys[] = {getenv("DBUS_SESSION_BUS_ADDRESS"), getenv("DISPLAY")};
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < sizeof(keys)/sizeof(keys[0]); i++) {
+        for (const char *c = keys[i] != NULL ? keys[i] : ""; true; c++) {
+            hash = (hash ^ (unsigned char)*c) * 0x100000001b3;
+            if (*c == '\0') {
+                break;
+            }
+        }
+    }
+    if (!allocSprintf(&path, "%s/xdg-screensaver-shim/backend-%016" PRIx64,
+                      runtimeDir, hash)) {
+        cleanReturn(false);
+    }
+cleanReturn:
+    *returnPath = path;
+    return returnValue;
+}
+
+// Read the cached backend (INHIBIT_BACKEND_NONE if not cached)
+void readProbeCache(const char *cachePath, enum inhibitBackend_t *returnBackend) {
+    enum inhibitBackend_t backend = INHIBIT_BACKEND_NONE;
+    char buf[32];
+    int cacheFd = open(cachePath, O_RDONLY | O_CLOEXEC);
+    if (cacheFd < 0) {
+        goto end;
+    }
+    ssize_t bufLen = read(cacheFd, buf, sizeof(buf) - NULL_BYTE_LEN);
+    close(cacheFd);
+    if (bufLen < 1 || buf[bufLen-1] != '\n') {
+        goto end;
+    }
+    buf[bufLen-1] = '\0';
+    for (int i = INHIBIT_BACKEND_NONE+1; i < INHIBIT_BACKENDS_LEN; i++) {
+        if (strcmp(buf, INHIBIT_BACKEND_NAMES[i]) == 0) {
+            backend = i;
+        }
+    }
+end:
+    *returnBackend = backend;
+}
+
+// Store the probed backend, the cache is only an optimization so errors are ignored
+void writeProbeCache(const char *cachePath, enum inhibitBackend_t backend) {
+    char *cacheDir = NULL, *tmpPath = NULL;
+    int tmpFd = -1;
+    if ((cacheDir = strdup(cachePath)) == NULL) {
+        goto end;
+    }
+    *strrchr(cacheDir, '/') = '\0';
+    if (mkdir(cacheDir, 0700) < 0 && errno != EEXIST) {
+        goto end;
+    }
+    // Replace atomically because other instances might read concurrently
+    if (!allocSprintf(&tmpPath, "%s.%d", cachePath, getpid())) {
+        goto end;
+    }
+    if ((tmpFd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) < 0) {
+        goto end;
+    }
+    if (dprintf(tmpFd, "%s\n", INHIBIT_BACKEND_NAMES[backend]) < 0 ||
+            rename(tmpPath, cachePath) < 0) {
+        unlink(tmpPath);
+    }
+end:
+    if (tmpFd != -1) {
+        close(tmpFd);
+    }
+    free(tmpPath);
+    free(cacheDir);
+}
+
+// Handles of xdgss_suspend_pid don't use X, the MIT-SCREEN-SAVER extension
+// would open the display (e.g. because it's in the probe cache)
+bool backendUsable(struct xdgss_handle *h, enum inhibitBackend_t backend) {
+    return h->pid == 0 || backend != INHIBIT_BACKEND_XSCREENSAVER;
+}
+
+// Inhibit screen saver with the backend that worked before (in this process or
+// according to the probe cache) or probe all backends
+bool inhibitProbed(struct xdgss_handle *h) {
+    bool returnValue = true;
+    struct xdgssData_t *d = &xdgssData;
+    char *cachePath = NULL;
+    enum inhibitBackend_t cachedBackend = d->probedBackend;
+    if (!allocProbeCachePath(&cachePath)) {
+        cleanReturn(false);
+    }
+    if (cachedBackend == INHIBIT_BACKEND_NONE && cachePath != NULL) {
+        readProbeCache(cachePath, &cachedBackend);
+    }
+    if (cachedBackend != INHIBIT_BACKEND_NONE && !backendUsable(h, cachedBackend)) {
+        // Probe the other backends without forgetting the cached one
+        cachedBackend = INHIBIT_BACKEND_NONE;
+    }
+    if (cachedBackend != INHIBIT_BACKEND_NONE) {
+        if (inhibitWithBackend(h, cachedBackend)) {
+            d->probedBackend = cachedBackend;
+            cleanReturn(true);
+        }
+        if (h->backend != INHIBIT_BACKEND_NONE) {
+            // Inhibited but failed afterwards
+            cleanReturn(false);
+        }
+        fprintf(stderr, "Cached backend %s failed, probing\n",
+                INHIBIT_BACKEND_NAMES[cachedBackend]);
+        d->probedBackend = INHIBIT_BACKEND_NONE;
+        if (cachePath != NULL) {
+            unlink(cachePath);
+        }
+    }
+    // The result is only remembered if no backend was skipped that the probe
+    // of other handles would prefer
+    bool skipped = false;
+    for (int i = INHIBIT_BACKEND_NONE+1; i < INHIBIT_BACKENDS_LEN; i++) {
+        if (i == cachedBackend) {
+            continue;
+        }
+        if (!backendUsable(h, i)) {
+            skipped = true;
+            continue;
+        }
+        if (inhibitWithBackend(h, i)) {
+            if (!skipped) {
+                d->probedBackend = i;
+                if (cachePath != NULL) {
+                    writeProbeCache(cachePath, i);
+                }
+            }
+            cleanReturn(true);
+        }
+        if (h->backend != INHIBIT_BACKEND_NONE) {
+            cleanReturn(false);
+        }
+    }
+    fprintf(stderr, "No screen saver inhibit backend available\n");
+    cleanReturn(false);
+cleanReturn:
+    // Not kept open for the lifetime of the inhibition
+    if (returnValue && !usesSessionBus(h->backend)) {
+        closeUnusedSessionBus();
+    }
+    free(cachePath);
+    return returnValue;
+}
+
+// Find the PID of the local client that owns window (0 if unknown or remote)
+pid_t findWindowOwner(Window window) {
+#ifdef HAVE_X11
+    struct xdgssData_t *d = &xdgssData;
+    pid_t pid = 0;
+#ifdef HAVE_XRES
+    int eventBase, errorBase;
+    if (XResQueryExtension(d->display, &eventBase, &errorBase)) {
+        // The server only knows the PID of local clients
+        XResClientIdSpec spec = {.client = window, .mask = XRES_CLIENT_ID_PID_MASK};
+        long idsLen = 0;
+        XResClientIdValue *ids = NULL;
+        trapXErrors();
+        Status status = XResQueryClientIds(d->display, 1, &spec, &idsLen, &ids);
+        if (untrapXErrors() == Success && status == Success) {
+            for (long i = 0; i < idsLen; i++) {
+                if (XResGetClientIdType(&ids[i]) == XRES_CLIENT_ID_PID_MASK) {
+                    pid = XResGetClientPid(&ids[i]);
+                }
+            }
+        }
+        XResClientIdsDestroy(idsLen, ids);
+        if (pid > 0) {
+            return pid;
+        }
+    }
+#endif
+    // _NET_WM_PID is only meaningful if the client runs on this host
+    char hostname[HOST_NAME_MAX + 1] = {0};
+    XTextProperty clientMachine = {0};
+    Atom type;
+    int format;
+    unsigned long itemsLen, bytesAfter;
+    unsigned char *prop = NULL;
+    trapXErrors();
+    Status status = XGetWMClientMachine(d->display, window, &clientMachine);
+    if (gethostname(hostname, sizeof(hostname) - NULL_BYTE_LEN) == 0 &&
+            status && clientMachine.format == 8 && clientMachine.value != NULL &&
+            strcmp((char *)clientMachine.value, hostname) == 0 &&
+            XGetWindowProperty(d->display, window,
+                               XInternAtom(d->display, "_NET_WM_PID", False),
+                               0, 1, False, XA_CARDINAL, &type, &format, &itemsLen,
+                               &bytesAfter, &prop) == Success &&
+            type == XA_CARDINAL && format == 32 && itemsLen == 1) {
+        pid = (pid_t)*(unsigned long *)prop;
+    }
+    if (untrapXErrors() != Success) {
+        pid = 0;
+    }
+    if (prop != NULL) {
+        XFree(prop);
+    }
+    if (clientMachine.value != NULL) {
+        XFree(clientMachine.value);
+    }
+    return pid;
+#else
+    return 0;
+#endif
+}
+
+// Release the inhibition of w's handle when process pid exits
+bool watchPid(struct xdgssWatch_t *w, pid_t pid) {
+    struct xdgssData_t *d = &xdgssData;
+    if ((w->pidFd = (int)syscall(SYS_pidfd_open, pid, 0)) < 0) {
+        w->pidFd = -1;
+        return false;
+    }
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = w};
+    if (epoll_ctl(d->epollFd, EPOLL_CTL_ADD, w->pidFd, &ev) < 0) {
+        fprintf(stderr, "Failed to watch process %d: %s\n", pid, strerror(errno));
+        close(w->pidFd);
+        w->pidFd = -1;
+        return false;
+    }
+    return true;
+}
+
+// Watch the process that owns the window with a pidfd instead of X events
+bool watchWindowOwner(struct xdgssWatch_t *w) {
+    pid_t pid = findWindowOwner(w->window);
+    return pid > 0 && watchPid(w, pid);
+}
+
+void unwatch(struct xdgssWatch_t *w) {
+    struct xdgssData_t *d = &xdgssData;
+    w->watching = false;
+    w->handle->watchingLen--;
+    if (w->pidFd != -1) {
+        // Closing doesn't remove it from epoll if the fd was duplicated (e.g.
+        // by fork), events would still arrive with a dangling data.ptr
+        epoll_ctl(d->epollFd, EPOLL_CTL_DEL, w->pidFd, NULL);
+        close(w->pidFd);
+        w->pidFd = -1;
+    } else if (w->window != None) {
+        unwatchWindow(w->window);
+    }
+}
+
+// Release the inhibition and stop watching
+bool deactivateHandle(struct xdgss_handle *h) {
+    bool returnValue = unInhibitWithBackend(h);
+    h->active = false;
+    for (size_t i = 0; i < h->watchesLen; i++) {
+        if (h->watches[i].watching) {
+            unwatch(&h->watches[i]);
+        }
+    }
+    return returnValue;
+}
+
+// Stop watching, the inhibition is released when nothing is watched anymore
+bool releaseWatch(struct xdgssWatch_t *w) {
+    unwatch(w);
+    if (w->handle->active && w->handle->watchingLen == 0) {
+        return deactivateHandle(w->handle);
+    }
+    return true;
+}
+
+// Inhibit until all windows are destroyed or, if pid is not 0, until process
+// pid exits
+xdgss_handle *suspendWatched(const unsigned long *windows, size_t windowsLen,
+                             unsigned int flags, pid_t pid) {
+    bool returnValue = true;
+    struct xdgssData_t *d = &xdgssData;
+    struct xdgss_handle *h = NULL;
+    size_t watchesLen = pid != 0 ? 1 : windowsLen;
+    if ((h = calloc(1, sizeof(struct xdgss_handle))) == NULL || (watchesLen > 0 &&
+            (h->watches = calloc(watchesLen, sizeof(struct xdgssWatch_t))) == NULL)) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+    h->window = pid == 0 && windowsLen > 0 ? windows[0] : None;
+    h->pid = pid;
+    h->logindInhibitFd = -1;
+    h->noReply = flags & XDGSS_NO_REPLY;
+    if (!initEpoll()) {
+        cleanReturn(false);
+    }
+    for (size_t i = 0; i < watchesLen; i++) {
+        struct xdgssWatch_t *w = &h->watches[i];
+        *w = (struct xdgssWatch_t){.handle = h, .window = pid != 0 ? None : windows[i],
+                                   .pidFd = -1};
+        if (pid != 0) {
+            if (!watchPid(w, pid)) {
+                fprintf(stderr, "Failed to open pidfd of process %d: %s\n", pid,
+                        strerror(errno));
+                cleanReturn(false);
+            }
+        } else if (!openDisplay()) {
+            cleanReturn(false);
+        } else if (!((flags & XDGSS_WATCH_OWNER) && watchWindowOwner(w)) &&
+                !watchWindow(w->window)) {
+            // Fall back to X events if the owner is remote or unknown
+            cleanReturn(false);
+        }
+        w->watching = true;
+        h->watchesLen++;
+        h->watchingLen++;
+    }
+    // Inhibit screen saver
+    if (!inhibitProbed(h)) {
+        cleanReturn(false);
+    }
+    h->active = true;
+    h->next = d->handles;
+    d->handles = h;
+cleanReturn:
+    if (!returnValue && h != NULL) {
+        deactivateHandle(h);
+        free(h->watches);
+        free(h);
+        h = NULL;
+    }
+    return h;
+}
+
+xdgss_handle *xdgss_suspend(unsigned long window) {
+    return xdgss_suspend_flags(window, 0);
+}
+
+xdgss_handle *xdgss_suspend_flags(unsigned long window, unsigned int flags) {
+    return suspendWatched(&window, window != None ? 1 : 0, flags, 0);
+}
+
+xdgss_handle *xdgss_suspend_windows(const unsigned long *windows, size_t windowsLen,
+                                    unsigned int flags) {
+    return suspendWatched(windows, windowsLen, flags, 0);
+}
+
+xdgss_handle *xdgss_suspend_pid(int pid) {
+    return xdgss_suspend_pid_flags(pid, 0);
+}
+
+xdgss_handle *xdgss_suspend_pid_flags(int pid, unsigned int flags) {
+    return suspendWatched(NULL, 0, flags & ~XDGSS_WATCH_OWNER, pid);
+}
+
+bool xdgss_release_window(xdgss_handle *handle, unsigned long window) {
+    bool returnValue = true;
+    for (size_t i = 0; i < handle->watchesLen; i++) {
+        struct xdgssWatch_t *w = &handle->watches[i];
+        if (w->watching && w->window == window && !releaseWatch(w)) {
+            returnValue = false;
+        }
+    }
+    return returnValue;
+}
+
+bool xdgss_resume(xdgss_handle *handle) {
+    bool returnValue = true;
+    struct xdgssData_t *d = &xdgssData;
+    if (handle == NULL) {
+        return true;
+    }
+    for (struct xdgss_handle **h = &d->handles; *h != NULL; h = &(*h)->next) {
+        if (*h == handle) {
+            *h = handle->next;
+            break;
+        }
+    }
+    if (handle->active) {
+        returnValue = deactivateHandle(handle);
+    }
+    free(handle->watches);
+    free(handle);
+    return returnValue;
+}
+
+bool xdgss_is_active(const xdgss_handle *handle) {
+    return handle->active;
+}
+
+void xdgss_get_info(const xdgss_handle *handle, xdgss_info *returnInfo) {
+    *returnInfo = (xdgss_info){
+        .backend = INHIBIT_BACKEND_NAMES[handle->backend],
+        .cookie = handle->backend == INHIBIT_BACKEND_SCREENSAVER ?
+                  handle->screenSaverInhibitCookie : 0};
+}
+
+void xdgss_get_stats(xdgss_stats *returnStats) {
+    *returnStats = xdgssData.stats;
+}
+
+int xdgss_get_fd(void) {
+    struct xdgssData_t *d = &xdgssData;
+    return initEpoll() ? d->epollFd : -1;
+}
+
+bool xdgss_dispatch(void) {
+    bool returnValue = true;
+    struct xdgssData_t *d = &xdgssData;
+    // Handle exited processes
+    struct epoll_event evs[16];
+    int evsLen;
+    while (d->epollFd != -1 &&
+            (evsLen = epoll_wait(d->epollFd, evs, sizeof(evs)/sizeof(evs[0]), 0)) > 0) {
+        bool processExited = false;
+        for (int i = 0; i < evsLen; i++) {
+            struct xdgssWatch_t *w = evs[i].data.ptr;
+            if (w == NULL) {
+                continue; // X connection
+            }
+            // Might have been released by an earlier event
+            xdgssTrace("process_exited", "\"window\":%lu,\"watching\":%s", w->window,
+                       TRACE_BOOL(w->watching));
+            PROBE2(process_exited, w->handle, w->window);
+            if (w->watching && !releaseWatch(w)) {
+                returnValue = false;
+            }
+            processExited = true;
+        }
+        if (!processExited) {
+            break;
+        }
+    }
+#ifdef HAVE_X11
+    if (d->display == NULL) {
+        return returnValue;
+    }
+    // Flush X requests and handle pending events (required before blocking)
+    while (XPending(d->display) > 0) {
+        XEvent ev;
+        XNextEvent(d->display, &ev);
+        PROBE2(x_event, ev.type, ev.xany.window);
+        if (ev.type >= 0 && ev.type < XDGSS_X_EVENT_TYPES) {
+            d->stats.x_events[ev.type]++;
+        }
+        if (ev.type != DestroyNotify) {
+            continue;
+        }
+        xdgssTrace("window_destroyed", "\"window\":%lu", ev.xdestroywindow.event);
+        for (struct xdgss_handle *h = d->handles; h != NULL; h = h->next) {
+            for (size_t i = 0; i < h->watchesLen; i++) {
+                struct xdgssWatch_t *w = &h->watches[i];
+                if (w->watching && w->pidFd == -1 && w->window == ev.xdestroywindow.event &&
+                        !releaseWatch(w)) {
+                    returnValue = false;
+                }
+            }
+        }
+    }
+#endif
+    return returnValue;
+}
+
+void xdgss_shutdown(void) {
+    struct xdgssData_t *d = &xdgssData;
+    for (struct xdgss_handle *h = d->handles; h != NULL; h = h->next) {
+        if (h->active) {
+            deactivateHandle(h);
+        }
+    }
+    closeDisplay();
+    DBusConnection **conns[] = {&d->sessionBusConn, &d->systemBusConn};
+    for (size_t i = 0; i < sizeof(conns)/sizeof(conns[0]); i++) {
+        if (*conns[i] != NULL) {
+            dbus_connection_close(*conns[i]);
+            dbus_connection_unref(*conns[i]);
+            *conns[i] = NULL;
+        }
+    }
+    if (d->epollFd != -1) {
+        close(d->epollFd);
+        d->epollFd = -1;
+    }
+}
+
+bool xdgss_resume_window(const char *exe, unsigned long window) {
+    bool returnValue = true;
+    struct xdgssData_t *d = &xdgssData;
+    // Release inhibitions of this process
+    for (struct xdgss_handle *h = d->handles; h != NULL; h = h->next) {
+        if (!xdgss_release_window(h, window)) {
+            returnValue = false;
+        }
+    }
+    // Kill all processes that suspend screen saver for window (ignore if the
+    // default xdg-screensaver is not installed)
+    if (!resumeProcesses(exe != NULL ? exe : XDGSS_CLI_PATH, exe == NULL, window, NULL)) {
+        returnValue = false;
+    }
+    return returnValue;
+}
+
+// Transient scope of the inhibiting processes
+#define SCOPE_UNIT "xdg-screensaver-shim.scope"
+
+// Signal of the user's service manager when a job finished
+#define JOB_REMOVED_MATCH "type='signal',sender='org.freedesktop.systemd1'," \
+    "path='/org/freedesktop/systemd1',interface='org.freedesktop.systemd1.Manager'," \
+    "member='JobRemoved'"
+// Time to wait for the job that starts the scope
+#define SCOPE_JOB_TIMEOUT_MS 1000
+
+// Call method of the user's service manager and wait for the reply,
+// returnErrorMatch is set if it failed with one of errorNames (NULL-terminated,
+// not reported), returnReplyMsg receives the reply (may be NULL)
+bool callSystemdMethod(DBusMessage *msg, const char *const errorNames[],
+                       bool *returnErrorMatch, DBusMessage **returnReplyMsg) {
+    DBusConnection *conn;
+    DBusMessage *replyMsg;
+    DBusError dbusErr;
+    *returnErrorMatch = false;
+    if ((conn = getDBusConnection(DBUS_BUS_SESSION)) == NULL) {
+        return false;
+    }
+    // Without systemd the call fails immediately instead of activating it
+    dbus_message_set_auto_start(msg, false);
+    dbus_error_init(&dbusErr);
+    replyMsg = dbus_connection_send_with_reply_and_block(conn, msg, DBUS_TIMEOUT_USE_DEFAULT,
+                                                         &dbusErr);
+    if (replyMsg == NULL) {
+        for (size_t i = 0; errorNames[i] != NULL; i++) {
+            *returnErrorMatch = *returnErrorMatch || dbus_error_has_name(&dbusErr, errorNames[i]);
+        }
+        // Missing systemd is not an error, joining just fails
+        if (!*returnErrorMatch && !dbus_error_has_name(&dbusErr, DBUS_ERROR_SERVICE_UNKNOWN) &&
+                !dbus_error_has_name(&dbusErr, DBUS_ERROR_NAME_HAS_NO_OWNER)) {
+            fprintf(stderr, "Failed to call systemd: %s\n", dbusErr.message);
+        }
+        dbus_error_free(&dbusErr);
+        return false;
+    }
+    if (returnReplyMsg != NULL) {
+        *returnReplyMsg = replyMsg;
+    } else {
+        dbus_message_unref(replyMsg);
+    }
+    return true;
+}
+
+// Move the calling process into the scope, returnMissing is set if the scope
+// doesn't exist or is stopping
+bool attachToScope(bool *returnMissing) {
+    bool returnValue = true;
+    DBusMessage *msg = NULL;
+    const char *unit = SCOPE_UNIT, *subcgroup = "";
+    dbus_uint32_t pid = (dbus_uint32_t)getpid();
+    const dbus_uint32_t *pids = &pid;
+    *returnMissing = false;
+    if ((msg = dbus_message_new_method_call("org.freedesktop.systemd1",
+                                            "/org/freedesktop/systemd1",
+                                            "org.freedesktop.systemd1.Manager",
+                                            "AttachProcessesToUnit")) == NULL ||
+            !dbus_message_append_args(msg, DBUS_TYPE_STRING, &unit, DBUS_TYPE_STRING, &subcgroup,
+                                      DBUS_TYPE_ARRAY, DBUS_TYPE_UINT32, &pids, 1,
+                                      DBUS_TYPE_INVALID)) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+    const char *const missingErrors[] = {"org.freedesktop.systemd1.NoSuchUnit",
+                                         "org.freedesktop.systemd1.UnitInactive", NULL};
+    if (!callSystemdMethod(msg, missingErrors, returnMissing, NULL)) {
+        cleanReturn(false);
+    }
+cleanReturn:
+    if (msg != NULL) {
+        dbus_message_unref(msg);
+    }
+    return returnValue;
+}
+
+// Append the property name with value of type (a basic type or an array of
+// elementType if type is DBUS_TYPE_ARRAY) to the a(sv) at iter
+bool appendProperty(DBusMessageIter *iter, const char *name, int type, int elementType,
+                    const void *value, int elementsLen) {
+    DBusMessageIter structIter, variantIter, arrayIter;
+    char signature[3] = {(char)type, type == DBUS_TYPE_ARRAY ? (char)elementType : '\0', '\0'};
+    return dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL, &structIter) &&
+           dbus_message_iter_append_basic(&structIter, DBUS_TYPE_STRING, &name) &&
+           dbus_message_iter_open_container(&structIter, DBUS_TYPE_VARIANT, signature,
+                                            &variantIter) &&
+           (type == DBUS_TYPE_ARRAY
+            ? dbus_message_iter_open_container(&variantIter, DBUS_TYPE_ARRAY, &signature[1],
+                                               &arrayIter) &&
+              dbus_message_iter_append_fixed_array(&arrayIter, elementType, &value,
+                                                   elementsLen) &&
+              dbus_message_iter_close_container(&variantIter, &arrayIter)
+            : dbus_message_iter_append_basic(&variantIter, type, value)) &&
+           dbus_message_iter_close_container(&structIter, &variantIter) &&
+           dbus_message_iter_close_container(iter, &structIter);
+}
+
+// Wait for the signal JobRemoved of job (JOB_REMOVED_MATCH must be added
+// before the job is started), returnDone is set if the job succeeded. Other
+// messages are dropped, nothing else receives messages on the connection.
+bool waitForJob(DBusConnection *conn, const char *job, bool *returnDone) {
+    struct timespec now, deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += SCOPE_JOB_TIMEOUT_MS / 1000;
+    deadline.tv_nsec += (SCOPE_JOB_TIMEOUT_MS % 1000) * 1000000;
+    *returnDone = false;
+    while (true) {
+        DBusMessage *msg;
+        while ((msg = dbus_connection_pop_message(conn)) != NULL) {
+            dbus_uint32_t id;
+            const char *removedJob, *unit, *result;
+            bool removed = dbus_message_is_signal(msg, "org.freedesktop.systemd1.Manager",
+                                                  "JobRemoved") &&
+                           dbus_message_get_args(msg, NULL, DBUS_TYPE_UINT32, &id,
+                                                 DBUS_TYPE_OBJECT_PATH, &removedJob,
+                                                 DBUS_TYPE_STRING, &unit, DBUS_TYPE_STRING,
+                                                 &result, DBUS_TYPE_INVALID) &&
+                           strcmp(removedJob, job) == 0;
+            if (removed) {
+                *returnDone = strcmp(result, "done") == 0;
+            }
+            dbus_message_unref(msg);
+            if (removed) {
+                return true;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int64_t timeoutMs = ((int64_t)(deadline.tv_sec - now.tv_sec) * 1000000000 +
+                             (deadline.tv_nsec - now.tv_nsec)) / 1000000;
+        if (timeoutMs <= 0) {
+            fprintf(stderr, "Timed out waiting for job %s\n", job);
+            return false;
+        }
+        if (!dbus_connection_read_write(conn, (int)timeoutMs)) {
+            return false;
+        }
+    }
+}
+
+// Start the scope with the calling process and wait until the job that moves
+// the process finished, returnExists is set if the scope exists already
+bool startScope(bool *returnExists) {
+    bool returnValue = true;
+    DBusConnection *conn = NULL;
+    DBusMessage *msg = NULL, *replyMsg = NULL;
+    DBusError dbusErr;
+    dbus_error_init(&dbusErr);
+    const char *unit = SCOPE_UNIT, *mode = "fail";
+    const char *description = "Processes of xdg-screensaver that inhibit the screen saver";
+    dbus_uint32_t pid = (dbus_uint32_t)getpid();
+    DBusMessageIter iter, propertiesIter, auxIter;
+    *returnExists = false;
+    if ((conn = getDBusConnection(DBUS_BUS_SESSION)) == NULL) {
+        return false;
+    }
+    // The job can finish before the reply arrives
+    dbus_bus_add_match(conn, JOB_REMOVED_MATCH, &dbusErr);
+    if (dbus_error_is_set(&dbusErr)) {
+        fprintf(stderr, "Failed to add match rule: %s\n", dbusErr.message);
+        dbus_error_free(&dbusErr);
+        return false;
+    }
+    if ((msg = dbus_message_new_method_call("org.freedesktop.systemd1",
+                                            "/org/freedesktop/systemd1",
+                                            "org.freedesktop.systemd1.Manager",
+                                            "StartTransientUnit")) == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+    dbus_message_iter_init_append(msg, &iter);
+    if (!dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &unit) ||
+            !dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &mode) ||
+            !dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(sv)", &propertiesIter) ||
+            !appendProperty(&propertiesIter, "Description", DBUS_TYPE_STRING, DBUS_TYPE_INVALID,
+                            &description, 0) ||
+            !appendProperty(&propertiesIter, "PIDs", DBUS_TYPE_ARRAY, DBUS_TYPE_UINT32, &pid, 1) ||
+            !dbus_message_iter_close_container(&iter, &propertiesIter) ||
+            !dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(sa(sv))", &auxIter) ||
+            !dbus_message_iter_close_container(&iter, &auxIter)) {
+        fprintf(stderr, "Out of memory\n");
+        cleanReturn(false);
+    }
+    const char *const existsErrors[] = {"org.freedesktop.systemd1.UnitExists", NULL};
+    if (!callSystemdMethod(msg, existsErrors, returnExists, &replyMsg)) {
+        cleanReturn(false);
+    }
+    const char *job;
+    bool done;
+    if (!dbus_message_get_args(replyMsg, &dbusErr, DBUS_TYPE_OBJECT_PATH, &job,
+                               DBUS_TYPE_INVALID)) {
+        fprintf(stderr, "Invalid reply of StartTransientUnit: %s\n", dbusErr.message);
+        dbus_error_free(&dbusErr);
+        cleanReturn(false);
+    }
+    if (!waitForJob(conn, job, &done) || !done) {
+        cleanReturn(false);
+    }
+cleanReturn:
+    // Without waiting for the reply
+    dbus_bus_remove_match(conn, JOB_REMOVED_MATCH, NULL);
+    if (replyMsg != NULL) {
+        dbus_message_unref(replyMsg);
+    }
+    if (msg != NULL) {
+        dbus_message_unref(msg);
+    }
+    return returnValue;
+}
+
+// Check if the calling process is a member of the scope
+bool inScope(bool *returnInUserService) {
+    char *path = NULL;
+    if (!allocSelfCgroupPath(&path) || path == NULL) {
+        *returnInUserService = false;
+        return false;
+    }
+    *returnInUserService = isUserServiceCgroup(path);
+    size_t pathLen = strlen(path), suffixLen = strlen("/" SCOPE_UNIT);
+    bool member = pathLen >= suffixLen && strcmp(&path[pathLen - suffixLen], "/" SCOPE_UNIT) == 0;
+    free(path);
+    return member;
+}
+
+bool xdgss_join_scope(void) {
+    struct xdgssData_t *d = &xdgssData;
+    bool inUserService, missing, exists;
+    if (inScope(&inUserService)) {
+        return true;
+    }
+    // The user's service manager can only move processes within its subtree
+    if (!inUserService) {
+        return false;
+    }
+    // Inhibitions with the cached backend don't use the session bus, joining
+    // would be their only D-Bus traffic
+    enum inhibitBackend_t cachedBackend = d->probedBackend;
+    char *cachePath = NULL;
+    if (cachedBackend == INHIBIT_BACKEND_NONE && allocProbeCachePath(&cachePath) &&
+            cachePath != NULL) {
+        readProbeCache(cachePath, &cachedBackend);
+    }
+    free(cachePath);
+    if (cachedBackend != INHIBIT_BACKEND_NONE && !usesSessionBus(cachedBackend)) {
+        return false;
+    }
+    if (attachToScope(&missing)) {
+        return true;
+    }
+    if (!missing) {
+        return false;
+    }
+    if (!startScope(&exists)) {
+        // Started by another process in the meantime
+        return exists && attachToScope(&missing);
+    }
+    return inScope(&inUserService);
+}
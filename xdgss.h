@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2021 Unrud <unrud@outlook.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XDGSS_H
+#define XDGSS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <signal.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define XDGSS_EXPORT __attribute__((visibility("default")))
+
+// In-process screen saver inhibition (not thread-safe)
+//
+// The library keeps one X connection and one D-Bus connection per bus open
+// for all handles. Errors are reported on stderr.
+
+typedef struct xdgss_handle xdgss_handle;
+
+// Inhibit the screen saver until the X window is destroyed or xdgss_resume
+// is called (NULL on failure), window 0 inhibits until xdgss_resume only
+XDGSS_EXPORT xdgss_handle *xdgss_suspend(unsigned long window);
+
+// Watch the process that owns the window (found with XRes or _NET_WM_PID)
+// with a pidfd instead of X events, falls back to X events for remote windows
+#define XDGSS_WATCH_OWNER (1 << 0)
+// Don't wait for the reply of the D-Bus call that releases the inhibition
+// (faster, but failures are not reported)
+#define XDGSS_NO_REPLY (1 << 1)
+
+// Like xdgss_suspend with XDGSS_* flags
+XDGSS_EXPORT xdgss_handle *xdgss_suspend_flags(unsigned long window, unsigned int flags);
+
+// Like xdgss_suspend_flags, but inhibit until all windows are destroyed
+XDGSS_EXPORT xdgss_handle *xdgss_suspend_windows(const unsigned long *windows,
+                                                 size_t windowsLen, unsigned int flags);
+
+// Inhibit the screen saver until process pid exits or xdgss_resume is called
+// (NULL on failure), doesn't use X (the MIT-SCREEN-SAVER backend is skipped)
+XDGSS_EXPORT xdgss_handle *xdgss_suspend_pid(int pid);
+
+// Like xdgss_suspend_pid with XDGSS_NO_REPLY (XDGSS_WATCH_OWNER is ignored)
+XDGSS_EXPORT xdgss_handle *xdgss_suspend_pid_flags(int pid, unsigned int flags);
+
+// Stop waiting for window, the inhibition is released with the last window
+XDGSS_EXPORT bool xdgss_release_window(xdgss_handle *handle, unsigned long window);
+
+// Release the inhibition (if still active) and free the handle
+XDGSS_EXPORT bool xdgss_resume(xdgss_handle *handle);
+
+// Check if the inhibition is still active (false after the windows got destroyed
+// or the watched process exited)
+XDGSS_EXPORT bool xdgss_is_active(const xdgss_handle *handle);
+
+typedef struct {
+    // Name of the backend ("screensaver", "portal", "xscreensaver", "logind"
+    // or "none" if released)
+    const char *backend;
+    // Cookie of org.freedesktop.ScreenSaver (0 for other backends)
+    unsigned int cookie;
+} xdgss_info;
+
+XDGSS_EXPORT void xdgss_get_info(const xdgss_handle *handle, xdgss_info *returnInfo);
+
+#define XDGSS_X_EVENT_TYPES 128
+#define XDGSS_RTT_BUCKETS 32
+
+// Counters of the library since it was loaded
+typedef struct {
+    // Processed X events by type
+    unsigned long x_events[XDGSS_X_EVENT_TYPES];
+    // D-Bus round trips, bucket i counts latencies of [2^i, 2^(i+1))
+    // microseconds (bucket 0 includes latencies below 1 microsecond)
+    unsigned long dbus_rtt[XDGSS_RTT_BUCKETS];
+} xdgss_stats;
+
+XDGSS_EXPORT void xdgss_get_stats(xdgss_stats *returnStats);
+
+// File descriptor to integrate into the caller's event loop (-1 on failure)
+// Wait for it to become readable and call xdgss_dispatch before waiting.
+XDGSS_EXPORT int xdgss_get_fd(void);
+
+// Process pending events and release inhibitions of destroyed windows and
+// exited owners
+XDGSS_EXPORT bool xdgss_dispatch(void);
+
+// Release all inhibitions of window, including those of other processes that
+// run "exe suspend window" (exe defaults to the installed xdg-screensaver,
+// "/proc/self/exe" refers to the calling program)
+// Processes that wait for several windows get XDGSS_RELEASE_WINDOW_SIGNAL with
+// the window as sival_ptr instead of SIGTERM.
+XDGSS_EXPORT bool xdgss_resume_window(const char *exe, unsigned long window);
+
+// Real-time signal, so that releases of several windows queue instead of
+// coalescing into one pending signal
+#define XDGSS_RELEASE_WINDOW_SIGNAL (SIGRTMIN + 1)
+
+// Move the calling process into the transient scope xdg-screensaver-shim.scope
+// of the user's service manager (started if it doesn't exist), whose members
+// xdgss_resume_window checks instead of scanning /proc. Fails without systemd
+// and for processes outside of the subtree of the user's service manager (e.g.
+// started from a login shell), which the service manager can't move. Also
+// fails without connecting if the backend in the probe cache doesn't use the
+// session bus.
+XDGSS_EXPORT bool xdgss_join_scope(void);
+
+// Release all inhibitions and close all connections (handles must still be
+// freed with xdgss_resume)
+XDGSS_EXPORT void xdgss_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif